@@ -0,0 +1,28 @@
+#include <pgamecc/util.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+using std::cout;
+using std::setw;
+
+
+// best of several runs, in milliseconds
+template<typename Func>
+double time_ms(const Func& f, int repeat = 3) {
+    double best = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < repeat; i++) {
+        pgamecc::Timer timer;
+        f();
+        best = std::min(best, timer.elapsed_us() / 1000.);
+    }
+    return best;
+}
+
+// keeps the optimizer from discarding a result
+template<typename T>
+void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
@@ -0,0 +1,282 @@
+#include "bench.h"
+
+#include <pgamecc/entropy.h>
+
+#include <random>
+#include <vector>
+
+using namespace pgamecc;
+
+
+// draws n values with each of: a std::mt19937 and a fresh distribution per
+// call as entropy used to do, the per-thread functions and a Generator
+template<typename Old, typename Thread, typename Own>
+static void
+bench_draw(const char* name, Old old, Thread thread, Own own) {
+    const int n = 1 << 22;
+    std::mt19937 mt{1};
+    entropy::Generator g(1);
+    double sum = 0;
+
+    cout << name << " x" << n << '\n';
+    double t0 = time_ms([&] { for (int i = 0; i < n; i++) sum += old(mt); });
+    double t1 = time_ms([&] { for (int i = 0; i < n; i++) sum += thread(); });
+    double t2 = time_ms([&] { for (int i = 0; i < n; i++) sum += own(g); });
+    keep(sum);
+    cout << "  mt19937      " << setw(8) << t0 << " ms\n"
+         << "  entropy::    " << setw(8) << t1 << " ms  speedup "
+         << t0 / t1 << '\n'
+         << "  Generator    " << setw(8) << t2 << " ms  speedup "
+         << t0 / t2 << '\n';
+}
+
+// n values one call at a time against a fill of a BulkGenerator
+template<typename T, typename One, typename Bulk>
+static void
+bench_bulk(const char* name, One one, Bulk bulk) {
+    const int n = 1 << 22;
+    entropy::Generator g(1);
+    entropy::BulkGenerator b(1);
+    std::vector<T> v(n);
+
+    cout << name << " x" << n << '\n';
+    double t0 = time_ms([&] { for (auto& x: v) x = one(g); });
+    double t1 = time_ms([&] { bulk(b, span<T>(v)); });
+    keep(v);
+    cout << "  Generator    " << setw(8) << t0 << " ms\n"
+         << "  bulk         " << setw(8) << t1 << " ms  speedup "
+         << t0 / t1 << '\n';
+}
+
+// one image of noise with the libnoise module point by point, and with
+// GradientNoise point by point, in batches and as a fill
+template<typename Libnoise>
+static void
+bench_noise(const char* name, const Libnoise& old,
+            GradientNoise::Fractal fractal) {
+    const ivec2 size(512, 512);
+    const dvec2 origin(-3.1, 7.3), step(1 / 64.);
+    Image<double> image(size);
+    std::vector<dvec3> points;
+    std::vector<double> out(size.x * size.y);
+    for (int y = 0; y < size.y; y++)
+        for (int x = 0; x < size.x; x++)
+            points.push_back(dvec3(origin + dvec2(x, y) * step, .5));
+
+    cout << name << " " << size.x << "x" << size.y << '\n';
+    double t0 = time_ms([&] {
+        for (size_t i = 0; i < points.size(); i++)
+            out[i] = old(points[i]);
+    });
+    keep(out);
+    for (auto basis: { GradientNoise::Basis::perlin,
+                       GradientNoise::Basis::simplex }) {
+        GradientNoise noise(basis, fractal);
+        double t1 = time_ms([&] {
+            for (size_t i = 0; i < points.size(); i++)
+                out[i] = noise(points[i]);
+        });
+        double t2 = time_ms([&] { noise(points, out); });
+        double t3 = time_ms([&] { noise.fill(image, origin, step); });
+        keep(out);
+        keep(image);
+        const char* b = basis == GradientNoise::Basis::perlin ? "perlin "
+                                                              : "simplex";
+        if (basis == GradientNoise::Basis::perlin)
+            cout << "  libnoise     " << setw(8) << t0 << " ms\n";
+        cout << "  " << b << " 3D   " << setw(8) << t1 << " ms  speedup "
+             << t0 / t1 << '\n'
+             << "  " << b << " span " << setw(8) << t2 << " ms  speedup "
+             << t0 / t2 << '\n'
+             << "  " << b << " fill " << setw(8) << t3 << " ms  speedup "
+             << t0 / t3 << '\n';
+    }
+}
+
+// a 2048x2048 map as demo/planet.cc used to make it, point by point, and
+// with fills on one thread and on all of them, in 2D and on a cube map face,
+// then the slopes of the map by differences and by analytic gradients
+static void
+bench_fill() {
+    const ivec2 size(2048, 2048);
+    const dvec2 origin(.5 / 2048), step(1 / 2048.);
+    const dvec3 origin3(-1, -1, 1), dx(2 / 2048., 0, 0), dy(0, 2 / 2048., 0);
+    Image<double> image(size);
+    PerlinNoise perlin;
+    GradientNoise noise;
+
+    cout << "noise map " << size.x << "x" << size.y << '\n';
+    double t0 = time_ms([&] {
+        image = Image<double>(size, [&](ivec2 i) {
+            return perlin(detail::pixel_center(i, size));
+        });
+    }, 1);
+    keep(image);
+    cout << "  libnoise     " << setw(8) << t0 << " ms\n";
+
+    auto report = [&](const char* name, double t) {
+        keep(image);
+        cout << "  " << name << setw(8) << t << " ms  speedup " << t0 / t
+             << '\n';
+    };
+    report("libnoise fill", time_ms([&] {
+        perlin.fill(image, origin, step, Parallel());
+    }, 1));
+    report("perlin 2D    ", time_ms([&] {
+        noise.fill(image, origin, step);
+    }));
+    report("  threads    ", time_ms([&] {
+        noise.fill(image, origin, step, Parallel());
+    }));
+    report("perlin face  ", time_ms([&] {
+        noise.fill(image, origin3, dx, dy);
+    }));
+    report("  threads    ", time_ms([&] {
+        noise.fill(image, origin3, dx, dy, Parallel());
+    }));
+
+    // slopes for a normal map, from central differences of four fills
+    // against one fill with gradients
+    Image<double> left(size), right(size), up(size), down(size);
+    Image<dvec2> gradient(size);
+    const double h = step.x / 2;
+    double t1 = time_ms([&] {
+        noise.fill(left, origin - dvec2(h, 0), step);
+        noise.fill(right, origin + dvec2(h, 0), step);
+        noise.fill(down, origin - dvec2(0, h), step);
+        noise.fill(up, origin + dvec2(0, h), step);
+    });
+    keep(up);
+    cout << "  differences  " << setw(8) << t1 << " ms\n";
+    double t2 = time_ms([&] { noise.fill(image, gradient, origin, step); });
+    keep(gradient);
+    cout << "  gradient     " << setw(8) << t2 << " ms  speedup "
+         << t1 / t2 << '\n';
+}
+
+// a warped terrain of two noises: module by module through images, each
+// noise on a fresh point per pixel, against the compiled graph, then the
+// cost of each node of the graph
+static void
+bench_graph() {
+    const ivec2 size(512, 512);
+    const dvec2 origin(.5 / 512), step(1 / 512.);
+    GradientNoise base, ridges(GradientNoise::Basis::perlin,
+                               GradientNoise::Fractal::ridged), warp;
+    warp.set_octaves(3);
+    Image<double> image(size);
+
+    cout << "noise graph " << size.x << "x" << size.y << '\n';
+    double t0 = time_ms([&] {
+        Image<double> w(size), r(size);
+        warp.fill(w, origin, step);
+        ridges.fill(r, origin, step);
+        image = Image<double>(size, [&](ivec2 i) {
+            dvec2 p = origin + dvec2(i) * step;
+            double a = base(p + w[i] * .4), t = r[i] * .5 + .5;
+            t = std::min(std::max(t, 0.), 1.);
+            return (a + (r[i] - a) * t) * .8 + .1;
+        });
+    }, 1);
+    keep(image);
+    cout << "  images       " << setw(8) << t0 << " ms\n";
+
+    NoiseGraph graph;
+    auto w = graph.noise(warp) * .4, r = graph.noise(ridges);
+    auto out = blend(graph.noise(base, w, w), r,
+                     clamp(r * .5 + .5, 0, 1)) * .8 + .1;
+    auto kernel = graph.compile(out);
+    double t1 = time_ms([&] { kernel.fill(image, origin, step); });
+    keep(image);
+    cout << "  kernel       " << setw(8) << t1 << " ms  speedup " << t0 / t1
+         << '\n';
+
+    std::vector<dvec2> points;
+    for (int y = 0; y < 64; y++)
+        for (int x = 0; x < size.x; x++)
+            points.push_back(origin + dvec2(x, y) * step);
+    for (auto& c: kernel.profile(span<const dvec2>(points)))
+        cout << "    " << std::left << setw(36) << c.name << std::right
+             << setw(8) << c.ns_per_point << " ns\n";
+}
+
+// a 512x512 cell map of about 1024 cells: nearest of random points by
+// brute force, as biome maps used to be made, against cellular noise
+static void
+bench_cellular() {
+    const ivec2 size(512, 512);
+    const dvec2 origin(.5 / 512), step(1 / 512.);
+    Image<double> image(size);
+
+    cout << "cell map " << size.x << "x" << size.y << '\n';
+    std::vector<dvec2> sites(1024);
+    for (auto& p: sites)
+        p = { entropy::uniform(), entropy::uniform() };
+    double t0 = time_ms([&] {
+        image = Image<double>(size, [&](ivec2 i) {
+            dvec2 p = origin + dvec2(i) * step;
+            double f1 = 1e30;
+            for (auto& s: sites)
+                f1 = std::min(f1, glm::length(p - s));
+            return f1;
+        });
+    }, 1);
+    keep(image);
+    cout << "  brute force  " << setw(8) << t0 << " ms\n";
+
+    CellularNoise noise;
+    noise.set_frequency(32);
+    Image<CellularSample> cells(size);
+    double t1 = time_ms([&] { noise.fill(cells, origin, step); });
+    keep(cells);
+    cout << "  cellular     " << setw(8) << t1 << " ms  speedup " << t0 / t1
+         << '\n';
+    noise.set_jitter(1);
+    double t2 = time_ms([&] { noise.fill(cells, origin, step); });
+    keep(cells);
+    cout << "  full jitter  " << setw(8) << t2 << " ms  speedup " << t0 / t2
+         << '\n';
+}
+
+int main() {
+    bench_draw("uniform",
+        [](std::mt19937& mt) {
+            return std::uniform_real_distribution<double>(0, 1)(mt);
+        },
+        [] { return entropy::uniform(); },
+        [](entropy::Generator& g) { return g.uniform(); });
+    bench_draw("normal",
+        [](std::mt19937& mt) {
+            return std::normal_distribution<double>(0, 1)(mt);
+        },
+        [] { return entropy::normal(); },
+        [](entropy::Generator& g) { return g.normal(); });
+    bench_draw("dice(6)",
+        [](std::mt19937& mt) {
+            return std::uniform_int_distribution<int>(0, 5)(mt);
+        },
+        [] { return entropy::dice(6); },
+        [](entropy::Generator& g) { return g.dice(6); });
+
+    bench_bulk<double>("bulk uniform",
+        [](entropy::Generator& g) { return g.uniform(); },
+        [](entropy::BulkGenerator& b, span<double> v) { b.uniform(v); });
+    bench_bulk<double>("bulk normal",
+        [](entropy::Generator& g) { return g.normal(); },
+        [](entropy::BulkGenerator& b, span<double> v) { b.normal(v); });
+    bench_bulk<double>("bulk exp",
+        [](entropy::Generator& g) { return g.exp(); },
+        [](entropy::BulkGenerator& b, span<double> v) { b.exp(v); });
+    bench_bulk<int>("bulk poisson(4)",
+        [](entropy::Generator& g) { return g.poisson(4); },
+        [](entropy::BulkGenerator& b, span<int> v) { b.poisson(v, 4); });
+    bench_bulk<int>("bulk dice(6)",
+        [](entropy::Generator& g) { return g.dice(6); },
+        [](entropy::BulkGenerator& b, span<int> v) { b.dice(v, 6); });
+
+    bench_noise("noise", PerlinNoise(), GradientNoise::Fractal::sum);
+    bench_noise("ridged noise", RidgedNoise(), GradientNoise::Fractal::ridged);
+    bench_fill();
+    bench_graph();
+    bench_cellular();
+}
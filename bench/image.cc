@@ -0,0 +1,373 @@
+#include "bench.h"
+
+#include <pgamecc/color.h>
+#include <pgamecc/convolve.h>
+#include <pgamecc/entropy.h>
+#include <pgamecc/image.h>
+#include <pgamecc/pixel.h>
+#include <pgamecc/resample.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace pgamecc;
+
+
+static void
+bench_parallel() {
+    Gradient<color::RGB> gradient;
+    gradient[0] = color::RGB{ .1, .2, .6 };
+    gradient[.5] = color::RGB{ .8, .7, .3 };
+    gradient[1] = color::RGB{ 1, 1, 1 };
+
+    PerlinNoise noise;
+    noise.reseed();
+
+    auto f = [&](dvec2 p) { return gradient((noise(p)+1)*.5); };
+    ivec2 size{1024, 1024};
+
+    cout << "make_image " << size.x << 'x' << size.y << " with PerlinNoise\n";
+    double serial = time_ms([&] { keep(make_image(size, f)); });
+    cout << "  serial      " << setw(8) << serial << " ms\n";
+
+    int max_threads = default_threads();
+    for (int threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        double t = time_ms([&] {
+            keep(make_image_parallel(size, f, threads));
+        });
+        cout << "  threads " << setw(3) << threads << ' ' << setw(8) << t
+             << " ms  speedup " << serial / t << '\n';
+        if (threads == max_threads)
+            break;
+    }
+}
+
+static void
+bench_gradient() {
+    Gradient<color::RGB> gradient;
+    gradient[0] = color::RGB{ .1, .2, .6 };
+    gradient[.3] = color::RGB{ .2, .5, .3 };
+    gradient[.5] = color::RGB{ .8, .7, .3 };
+    gradient[.8] = color::RGB{ .6, .6, .6 };
+    gradient[1] = color::RGB{ 1, 1, 1 };
+    auto baked = gradient.bake();
+
+    const int n = 1 << 20;
+    std::vector<double> v(n);
+    for (int i = 0; i < n; i++)
+        v[i] = (i * 0x9e3779b9u % n) / (double)n;
+    std::vector<color::RGB> out(n);
+
+    cout << "Gradient, " << n << " values\n";
+    double map = time_ms([&] {
+        for (int i = 0; i < n; i++)
+            out[i] = gradient(v[i]);
+        keep(out[n/2]);
+    });
+    double table = time_ms([&] {
+        for (int i = 0; i < n; i++)
+            out[i] = baked(v[i]);
+        keep(out[n/2]);
+    });
+    double batch = time_ms([&] { baked.evaluate(v, out); keep(out[n/2]); });
+    cout << "  std::map      " << setw(8) << map << " ms\n"
+         << "  baked         " << setw(8) << table << " ms\n"
+         << "  evaluate      " << setw(8) << batch << " ms\n";
+}
+
+
+// LinearSampler as it was before the unchecked access layer, for comparison
+template<typename Color>
+static Color
+checked_linear(const Image<Color>& image, dvec2 p) {
+    auto sample = [&](ivec2 i) {
+        return image[glm::clamp(i, ivec2(0), image.size()-1)];
+    };
+    auto f = p * dvec2(image.size()) - .5;
+    auto i = ivec2(glm::floor(f));
+    f -= i;
+    if (f == dvec2(0, 0))
+        return sample(i);
+    auto v0 = (1-f.x) * sample(i) + f.x * sample(i+ivec2(1, 0));
+    auto v1 = (1-f.x) * sample(i+ivec2(0, 1)) + f.x * sample(i+1);
+    return (1-f.y) * v0 + f.y * v1;
+}
+
+static void
+bench_sampler() {
+    auto image = make_image(ivec2{1024, 1024},
+        [](dvec2 p) { return color::RGB{ p.x, p.y, p.x * p.y }; });
+
+    const int n = 1 << 22;
+    std::vector<dvec2> points(n);
+    for (auto& p: points)
+        p = dvec2(entropy::uniform(), entropy::uniform());
+
+    cout << "LinearSampler, " << n << " random samples\n";
+    double checked = time_ms([&] {
+        color::RGB sum{};
+        for (auto p: points)
+            sum = sum + checked_linear(image, p);
+        keep(sum);
+    });
+    double unchecked = time_ms([&] {
+        auto l = image.linear();
+        color::RGB sum{};
+        for (auto p: points)
+            sum = sum + l(p);
+        keep(sum);
+    });
+    std::vector<color::RGB> out(n);
+    double batch = time_ms([&] {
+        image.linear()(points, out);
+        keep(out[n/2]);
+    });
+    double cubic = time_ms([&] {
+        image.cubic()(points, out);
+        keep(out[n/2]);
+    });
+    // the same number of samples on a regular grid, as in a zoomed view
+    ivec2 count{2048, n / 2048};
+    dvec2 step = 1. / dvec2(count);
+    double grid = time_ms([&] {
+        image.linear().grid(step * .5, step, count, out);
+        keep(out[n/2]);
+    });
+    double cubic_grid = time_ms([&] {
+        image.cubic().grid(step * .5, step, count, out);
+        keep(out[n/2]);
+    });
+    cout << "  checked     " << setw(8) << checked * 1e6 / n << " ns/sample\n"
+         << "  unchecked   " << setw(8) << unchecked * 1e6 / n
+         << " ns/sample\n"
+         << "  batch       " << setw(8) << batch * 1e6 / n << " ns/sample\n"
+         << "  grid        " << setw(8) << grid * 1e6 / n << " ns/sample\n"
+         << "  cubic batch " << setw(8) << cubic * 1e6 / n << " ns/sample\n"
+         << "  cubic grid  " << setw(8) << cubic_grid * 1e6 / n
+         << " ns/sample\n";
+
+    cout << "row sum over " << image.size().x << 'x' << image.size().y
+         << " pixels\n";
+    double indexed = time_ms([&] {
+        color::RGB sum{};
+        for (int y = 0; y < image.size().y; y++)
+            for (int x = 0; x < image.size().x; x++)
+                sum = sum + image[ivec2(x, y)];
+        keep(sum);
+    });
+    double rows = time_ms([&] {
+        color::RGB sum{};
+        for (int y = 0; y < image.size().y; y++)
+            for (auto c: image.row(y))
+                sum = sum + c;
+        keep(sum);
+    });
+    int pixels = image.size().x * image.size().y;
+    cout << "  operator[]  " << setw(8) << indexed * 1e6 / pixels
+         << " ns/pixel\n"
+         << "  row()       " << setw(8) << rows * 1e6 / pixels
+         << " ns/pixel\n";
+}
+
+
+static void
+bench_resample() {
+    auto image = make_image(ivec2{2048, 2048},
+        [](dvec2 p) { return color::RGB{ p.x, p.y, p.x * p.y }; });
+    ivec2 size{1000, 1000};
+
+    cout << "resample 2048x2048 to 1000x1000\n";
+    double sampler = time_ms([&] { keep(make_image(size, image.linear())); });
+    cout << "  LinearSampler " << setw(8) << sampler << " ms\n";
+    for (auto filter: { Filter::box, Filter::bilinear, Filter::lanczos }) {
+        double t = time_ms([&] { keep(resample(image, size, filter)); });
+        cout << "  filter " << (int)filter << "      " << setw(8) << t
+             << " ms\n";
+    }
+    double mip = time_ms([&] { keep(mip_pyramid(image)); });
+    cout << "  mip_pyramid   " << setw(8) << mip << " ms\n";
+}
+
+
+template<typename Layout>
+static void
+bench_layout(const char* name, const Image<color::RGB>& source,
+             const std::vector<dvec2>& points) {
+    Image<color::RGB, Layout> image(source);
+    ivec2 size = image.size();
+
+    double sampler = time_ms([&] {
+        auto l = image.linear();
+        color::RGB sum{};
+        for (auto p: points)
+            sum = sum + l(p);
+        keep(sum);
+    });
+
+    // 9-tap vertical box blur, column by column
+    const int r = 4;
+    double blur = time_ms([&] {
+        Image<color::RGB, Layout> out(size);
+        for (int x = 0; x < size.x; x++)
+            for (int y = r; y < size.y - r; y++) {
+                color::RGB sum{};
+                for (int k = -r; k <= r; k++)
+                    sum = sum + image.at_unsafe(ivec2(x, y + k));
+                out.at_unsafe(ivec2(x, y)) = sum / (2*r + 1);
+            }
+        keep(out);
+    });
+
+    cout << "  " << name << setw(12 - std::strlen(name)) << ' '
+         << setw(8) << sampler * 1e6 / points.size() << " ns/sample "
+         << setw(8) << blur * 1e6 / size.x / size.y << " ns/pixel\n";
+}
+
+static void
+bench_layouts() {
+    auto image = make_image(ivec2{2048, 2048},
+        [](dvec2 p) { return color::RGB{ p.x, p.y, p.x * p.y }; });
+
+    // a rotated and scaled walk, as in texture warping
+    std::vector<dvec2> points;
+    for (int j = 0; j < 1024; j++)
+        for (int i = 0; i < 1024; i++) {
+            dvec2 p(i / 1024., j / 1024.);
+            points.emplace_back(.5 + (p.x - .5) * .6 - (p.y - .5) * .8,
+                                .5 + (p.x - .5) * .8 + (p.y - .5) * .6);
+        }
+
+    cout << "layouts: rotated LinearSampler, vertical blur\n";
+    bench_layout<RowMajor>("RowMajor", image, points);
+    bench_layout<Tiled<8>>("Tiled<8>", image, points);
+    bench_layout<Tiled<16>>("Tiled<16>", image, points);
+    bench_layout<Morton>("Morton", image, points);
+}
+
+
+static void
+bench_convolve() {
+    auto image = make_image(ivec2{2048, 2048},
+        [](dvec2 p) { return color::RGB{ p.x, p.y, p.x * p.y }; });
+    ivec2 size = image.size();
+
+    cout << "convolve 2048x2048 RGB\n";
+    const int r = 4;
+    double naive = time_ms([&] {
+        keep(Image<color::RGB>(size, [&](ivec2 i) {
+            color::RGB sum{};
+            for (int dy = -r; dy <= r; dy++)
+                for (int dx = -r; dx <= r; dx++)
+                    sum = sum + image[glm::clamp(i + ivec2(dx, dy),
+                                                 ivec2(0), size - 1)];
+            return sum / ((2*r + 1) * (2*r + 1));
+        }));
+    });
+    cout << "  naive box r=4 " << setw(8) << naive << " ms\n";
+    for (int radius: { 4, 32 }) {
+        double t = time_ms([&] { keep(box_blur(image, radius)); });
+        double p = time_ms([&] {
+            keep(box_blur(image, radius, Parallel()));
+        });
+        cout << "  box r=" << setw(2) << radius << "      " << setw(8) << t
+             << " ms " << setw(8) << p << " ms parallel\n";
+    }
+    for (double sigma: { 1., 4. }) {
+        double t = time_ms([&] { keep(gaussian_blur(image, sigma)); });
+        double p = time_ms([&] {
+            keep(gaussian_blur(image, sigma, Parallel()));
+        });
+        cout << "  gaussian s=" << sigma << "  " << setw(8) << t
+             << " ms " << setw(8) << p << " ms parallel\n";
+    }
+}
+
+static void
+bench_color() {
+    ivec2 size{1024, 1024};
+    Image<color::sRGB> image(size, [](ivec2 i) {
+        return color::sRGB{ i.x / 1024., i.y / 1024., (i.x ^ i.y) / 1024. };
+    });
+    auto rgb = to_rgb(image, color::Precision::exact);
+    double mpix = size.x * size.y / 1e6;
+
+    cout << "color conversion " << size.x << 'x' << size.y << '\n';
+    auto report = [&](const char* name, double per_pixel, double batch) {
+        cout << "  " << name << setw(8) << per_pixel << " ms "
+             << setw(8) << batch << " ms batch  "
+             << mpix / batch * 1000 << " Mpixel/s\n";
+    };
+    double t = time_ms([&] {
+        keep(Image<color::sRGB>(size, [&](ivec2 i) {
+            return rgb[i].srgb();
+        }));
+    });
+    report("RGB->sRGB exact", t, time_ms([&] {
+        keep(to_srgb(rgb, color::Precision::exact));
+    }));
+    report("RGB->sRGB fast ", t, time_ms([&] { keep(to_srgb(rgb)); }));
+    t = time_ms([&] {
+        keep(Image<color::RGB>(size, [&](ivec2 i) {
+            return image[i].rgb();
+        }));
+    });
+    report("sRGB->RGB fast ", t, time_ms([&] { keep(to_rgb(image)); }));
+    t = time_ms([&] {
+        keep(Image<color::YCH>(size, [&](ivec2 i) {
+            return image[i].ych();
+        }));
+    });
+    report("sRGB->YCH      ", t, time_ms([&] { keep(to_ych(image)); }));
+    auto ych = to_ych(image);
+    t = time_ms([&] {
+        keep(Image<color::sRGB>(size, [&](ivec2 i) {
+            return ych[i].srgb();
+        }));
+    });
+    report("YCH->sRGB      ", t, time_ms([&] { keep(to_srgb(ych)); }));
+}
+
+static void
+bench_srgb8() {
+    ivec2 size{2048, 2048};
+    Image<color::RGB> image(size, [](ivec2 i) {
+        return color::RGB{ i.x / 2048., i.y / 2048., (i.x ^ i.y) / 2048. };
+    });
+    double mb = size.x * size.y * 4 / 1e6;
+
+    cout << "sRGB8 encode " << size.x << 'x' << size.y << '\n';
+    double t = time_ms([&] {
+        keep(Image<SRGB8_ALPHA8>(size, [&](ivec2 i) {
+            auto c = image[i].srgb();
+            SRGB8_ALPHA8 p;
+            p.r.bits = std::lround(c.r * 255);
+            p.g.bits = std::lround(c.g * 255);
+            p.b.bits = std::lround(c.b * 255);
+            p.a.bits = 255;
+            return p;
+        }));
+    });
+    cout << "  std::pow      " << setw(8) << t << " ms\n";
+    t = time_ms([&] { keep(encode_srgb8(image)); });
+    cout << "  table         " << setw(8) << t << " ms  "
+         << mb / t * 1000 << " MB/s\n";
+    t = time_ms([&] { keep(encode_srgb8(image, Parallel())); });
+    cout << "  table threads " << setw(8) << t << " ms  "
+         << mb / t * 1000 << " MB/s\n";
+    auto encoded = encode_srgb8(image);
+    t = time_ms([&] { keep(decode_srgb8(encoded)); });
+    cout << "  decode        " << setw(8) << t << " ms\n";
+}
+
+
+int main() {
+    bench_parallel();
+    bench_gradient();
+    bench_sampler();
+    bench_resample();
+    bench_layouts();
+    bench_convolve();
+    bench_color();
+    bench_srgb8();
+}
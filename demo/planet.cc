@@ -112,8 +112,14 @@ public:
         PerlinNoise noise;
         noise.reseed();
 
-        return make_image(ivec2{1000, 1000},
-            [&](dvec2 p) { return gradient((noise(p)+1)*.5); });
+        // noise at pixel centers in [0, 1] coordinates
+        ivec2 size{1000, 1000};
+        Image<double> heights(size);
+        noise.fill(heights, .5 / dvec2(size), 1. / dvec2(size), Parallel());
+
+        auto baked = gradient.bake();
+        return Image<color::RGB>(size,
+            [&](ivec2 i) { return baked((heights[i]+1)*.5); });
     }
 
     Image<color::RGB> planet_image;
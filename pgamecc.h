@@ -4,6 +4,13 @@
 #include <pgamecc/util.h>
 #include <pgamecc/color.h>
 #include <pgamecc/image.h>
+#include <pgamecc/pixel.h>
+#include <pgamecc/sampler.h>
+#include <pgamecc/resample.h>
+#include <pgamecc/convolve.h>
+#include <pgamecc/stats.h>
+#include <pgamecc/cache.h>
+#include <pgamecc/dirty.h>
 #include <pgamecc/tiles.h>
 #include <pgamecc/loc.h>
 #include <pgamecc/types.h>
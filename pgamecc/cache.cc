@@ -0,0 +1,200 @@
+#include "cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+using std::ofstream;
+using std::ostringstream;
+using std::runtime_error;
+using std::string;
+
+using namespace pgamecc;
+
+
+static runtime_error
+file_error(const string& what, const string& path)
+{
+    return runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+
+//
+// detail::MappedFile
+//
+
+detail::MappedFile::MappedFile(const string& path) :
+    _data(nullptr), _size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw file_error("can't open", path);
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        auto e = file_error("can't stat", path);
+        close(fd);
+        throw e;
+    }
+    _size = st.st_size;
+
+    if (_size) {
+        void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            auto e = file_error("can't map", path);
+            close(fd);
+            throw e;
+        }
+        _data = data;
+    }
+    close(fd); // mapping stays valid
+}
+
+detail::MappedFile::~MappedFile()
+{
+    if (_data)
+        munmap(_data, _size);
+}
+
+detail::MappedFile::MappedFile(MappedFile&& r) :
+    _data(r._data), _size(r._size)
+{
+    r._data = nullptr;
+    r._size = 0;
+}
+
+detail::MappedFile&
+detail::MappedFile::operator=(MappedFile&& r)
+{
+    if (this != &r) {
+        if (_data)
+            munmap(_data, _size);
+        _data = r._data;
+        _size = r._size;
+        r._data = nullptr;
+        r._size = 0;
+    }
+    return *this;
+}
+
+
+//
+// image file format
+//
+
+namespace {
+
+const char image_magic[8] = "PGIMAGE";
+const uint32_t image_version = 1;
+
+// pixels start at a cache line boundary
+const size_t image_header_size = 64;
+
+struct ImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pixel_size;
+    uint64_t tag;
+    int32_t width, height;
+};
+
+static_assert(sizeof(ImageHeader) <= image_header_size,
+              "image file header too large");
+
+}
+
+uint64_t
+detail::hash_bytes(const void* data, size_t size, uint64_t h)
+{
+    auto p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+void
+detail::write_image_file(const string& path, ivec2 size,
+                         size_t pixel_size, uint64_t tag, const void* pixels)
+{
+    char header[image_header_size] = {};
+    ImageHeader h{};
+    std::memcpy(h.magic, image_magic, sizeof h.magic);
+    h.version = image_version;
+    h.pixel_size = pixel_size;
+    h.tag = tag;
+    h.width = size.x;
+    h.height = size.y;
+    std::memcpy(header, &h, sizeof h);
+
+    ostringstream temp;
+    temp << path << ".tmp" << getpid();
+    {
+        ofstream f(temp.str(), ofstream::binary | ofstream::trunc);
+        f.write(header, sizeof header);
+        f.write(static_cast<const char*>(pixels),
+                (std::streamsize)pixel_size * size.x * size.y);
+        f.close();
+        if (!f) {
+            std::remove(temp.str().c_str());
+            throw file_error("can't write", path);
+        }
+    }
+    if (std::rename(temp.str().c_str(), path.c_str()) < 0) {
+        auto e = file_error("can't rename to", path);
+        std::remove(temp.str().c_str());
+        throw e;
+    }
+}
+
+const void*
+detail::read_image_file(const MappedFile& file, ivec2& size,
+                        size_t pixel_size, uint64_t tag)
+{
+    ImageHeader h;
+    if (file.size() < image_header_size)
+        throw runtime_error("image file too short");
+    std::memcpy(&h, file.data(), sizeof h);
+    if (std::memcmp(h.magic, image_magic, sizeof h.magic) ||
+            h.version != image_version)
+        throw runtime_error("not an image file");
+    if (h.pixel_size != pixel_size || h.tag != tag)
+        throw runtime_error("image file has different pixel type");
+    if (h.width < 0 || h.height < 0 || file.size() !=
+            image_header_size + pixel_size * h.width * h.height)
+        throw runtime_error("image file has wrong size");
+
+    size = ivec2(h.width, h.height);
+    return static_cast<const char*>(file.data()) + image_header_size;
+}
+
+
+//
+// ImageCache
+//
+
+ImageCache::ImageCache(const string& directory) :
+    directory(directory)
+{
+    if (mkdir(directory.c_str(), 0777) < 0 && errno != EEXIST)
+        throw file_error("can't create", directory);
+}
+
+string
+ImageCache::path(uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof name, "%016llx.img", (unsigned long long)key);
+    return directory + "/" + name;
+}
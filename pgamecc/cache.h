@@ -0,0 +1,199 @@
+#ifndef PGAMECC_CACHE_H
+#define PGAMECC_CACHE_H
+
+#include <pgamecc/image.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+
+namespace pgamecc {
+
+// Images can be saved in a simple binary format: a fixed-size header followed
+// by the raw pixels. Files are read back by mapping them into memory, without
+// parsing or copying, so they are only portable between identical builds.
+
+namespace detail {
+
+// read-only mapping of a whole file
+class MappedFile {
+    void* _data;
+    size_t _size;
+
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(MappedFile&&);
+    MappedFile& operator=(MappedFile&&);
+
+    const void* data() const { return _data; }
+    size_t size() const { return _size; }
+};
+
+// 64-bit FNV-1a
+uint64_t hash_bytes(const void* data, size_t size,
+                    uint64_t h = 0xcbf29ce484222325);
+
+// tag stored in the header to tell apart pixel types of the same size
+template<typename Color>
+uint64_t pixel_tag() {
+    auto name = typeid(Color).name();
+    return hash_bytes(name, std::char_traits<char>::length(name));
+}
+
+// writes to a temporary file first, so readers never see partial files
+void write_image_file(const std::string& path, ivec2 size,
+                      size_t pixel_size, uint64_t tag, const void* pixels);
+
+// checks the header and returns the pixels
+const void* read_image_file(const MappedFile& file, ivec2& size,
+                            size_t pixel_size, uint64_t tag);
+
+// Each part of a key goes through the hash_part() overload for its type.
+// All of them are declared before hash_key(), whose calls would otherwise
+// only see the generic one and hash a const char* by its address.
+template<typename T>
+uint64_t
+hash_part(uint64_t h, const T& value)
+{
+    // any padding bytes in T would make the hash unreliable
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "cache key parts must be strings or trivially copyable");
+    static_assert(!std::is_pointer<T>::value,
+                  "cache key parts must not be pointers, which would be "
+                  "hashed by address");
+    return hash_bytes(&value, sizeof value, h);
+}
+
+inline uint64_t
+hash_part(uint64_t h, const std::string& value)
+{
+    // include the length so that ("ab", "c") differs from ("a", "bc")
+    return hash_bytes(value.data(), value.size(),
+                      hash_part(h, value.size()));
+}
+
+inline uint64_t
+hash_part(uint64_t h, const char* value)
+{
+    return hash_part(h, std::string(value));
+}
+
+inline uint64_t
+hash_part(uint64_t h, char* value)
+{
+    return hash_part(h, std::string(value));
+}
+
+// string literals, hashed as the strings they hold
+template<size_t N>
+uint64_t
+hash_part(uint64_t h, const char (&value)[N])
+{
+    return hash_part(h, std::string(value));
+}
+
+inline uint64_t
+hash_key(uint64_t h) { return h; }
+
+template<typename T, typename... Key>
+uint64_t
+hash_key(uint64_t h, const T& value, const Key&... key)
+{
+    return hash_key(hash_part(h, value), key...);
+}
+
+}
+
+template<typename Color>
+void
+save_image(const Image<Color>& image, const std::string& path)
+{
+    static_assert(std::is_trivially_copyable<Color>::value,
+                  "only trivially copyable pixels can be saved");
+    detail::write_image_file(path, image.size(), sizeof(Color),
+                             detail::pixel_tag<Color>(),
+                             image.pixels().data());
+}
+
+// Image in a memory-mapped file written by save_image(). Pixels are read
+// straight from the mapping, which stays valid while this object exists.
+template<typename Color>
+class MappedImage {
+    static_assert(std::is_trivially_copyable<Color>::value,
+                  "only trivially copyable pixels can be mapped");
+
+    detail::MappedFile file;
+    ivec2 _size;
+    const Color* _pixels;
+
+public:
+    // throws std::runtime_error if the file can't be read or doesn't match
+    explicit MappedImage(const std::string& path) :
+        file(path),
+        _pixels(static_cast<const Color*>(detail::read_image_file(
+            file, _size, sizeof(Color), detail::pixel_tag<Color>()))) {}
+
+    ivec2 size() const { return _size; }
+    span<const Color> pixels() const {
+        return { _pixels, (size_t)_size.x * _size.y };
+    }
+
+    Color operator[](ivec2 i) const {
+        if (i.x < 0 || i.x >= _size.x || i.y < 0 || i.y >= _size.y)
+            throw std::out_of_range("coordinates outside Image bounds");
+        return at_unsafe(i);
+    }
+    const Color& at_unsafe(ivec2 i) const {
+        return _pixels[i.x + (size_t)i.y * _size.x];
+    }
+    span<const Color> row(int y) const {
+        return { _pixels + (size_t)y * _size.x, (size_t)_size.x };
+    }
+
+    // zero-copy view of the mapping, valid while this MappedImage lives
+    ImageView<const Color> view() const { return { _pixels, _size }; }
+
+    // copy into memory
+    Image<Color> image() const {
+        return { _size, [&](ivec2 start, span<Color> row) {
+            std::copy(_pixels + (size_t)start.y * _size.x,
+                      _pixels + (size_t)(start.y+1) * _size.x, row.begin());
+        } };
+    }
+};
+
+// Directory of generated images, keyed by a hash of the size, the pixel type
+// and all parameters that affect the result, such as seeds. Key parts are
+// strings or trivially copyable values without padding.
+class ImageCache {
+    std::string directory;
+
+public:
+    // creates the directory if needed
+    explicit ImageCache(const std::string& directory);
+
+    std::string path(uint64_t key) const;
+
+    // Maps the cached image for the key, or calls make_image(size, f) and
+    // stores the result first.
+    template<typename Func, typename... Key>
+    auto make_image(ivec2 size, const Func& f, const Key&... key) {
+        typedef std::decay_t<decltype(f(dvec2()))> Color;
+        auto file = path(detail::hash_key(detail::pixel_tag<Color>(),
+                                          size.x, size.y, key...));
+        try {
+            return MappedImage<Color>(file);
+        } catch (std::runtime_error&) {
+            // missing or unreadable, regenerate
+        }
+        save_image(pgamecc::make_image(size, f), file);
+        return MappedImage<Color>(file);
+    }
+};
+
+}
+
+#endif
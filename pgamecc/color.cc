@@ -1,98 +1,311 @@
 #include "color.h"
 
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using pgamecc::span;
 using namespace pgamecc::color;
 
 
-static double
-gamma_compress(double v) {
-    return v > .0031308 ? 1.055 * std::pow(v, 1/2.4) - .055
-                        : 12.92 * v;
+template<typename T> static T
+gamma_compress(T v) {
+    return v > T(.0031308) ? T(1.055) * std::pow(v, T(1/2.4)) - T(.055)
+                           : T(12.92) * v;
 }
 
-static double
-gamma_expand(double v) {
-    return v > .04045 ? std::pow((v + .055) / 1.055, 2.4)
-                        : v / 12.92;
+template<typename T> static T
+gamma_expand(T v) {
+    return v > T(.04045) ? std::pow((v + T(.055)) / T(1.055), T(2.4))
+                         : v / T(12.92);
 }
 
-static double
-hue_as_red(double h) {
-    h = (h < 0 ? 6 : 0) + std::fmod(h, 6); // normalize to [0, 6]
-    return std::max(0., std::min(1., -1 + std::abs(h - 3)));
+template<typename T> static T
+hue_as_red(T h) {
+    h = (h < 0 ? 6 : 0) + std::fmod(h, T(6)); // normalize to [0, 6]
+    return std::max(T(0), std::min(T(1), -1 + std::abs(h - 3)));
 };
 
+// hue in [0, 6) given max M and chroma c of the channels
+template<typename T> static T
+hue_of(T r, T g, T b, T M, T c) {
+    return c == 0 ? 0 :
+           M == g ? 2 + (b - r) / c :
+           M == b ? 4 + (r - g) / c :
+                    (g < b ? 6 : 0) + (g - b) / c;
+}
+
+template<typename T> static T
+luma_of(T r, T g, T b) {
+    return T(.2126) * r + T(.7152) * g + T(.0722) * b; // Rec. 709 formula
+}
+
 
-sRGB
-RGB::srgb() const {
+template<typename T> BasicSRGB<T>
+BasicRGB<T>::srgb() const {
     return { gamma_compress(r),
              gamma_compress(g),
              gamma_compress(b) };
 }
 
 
-RGB
-sRGB::rgb() const {
+template<typename T> BasicRGB<T>
+BasicSRGB<T>::rgb() const {
     return { gamma_expand(r),
              gamma_expand(g),
              gamma_expand(b) };
 }
 
 
-HSL
-sRGB::hue() const {
-    return HSL::hue(hsl().h);
+template<typename T> BasicHSL<T>
+BasicSRGB<T>::hue() const {
+    return BasicHSL<T>::hue(hsl().h);
 }
 
 
-HSL
-sRGB::hsl() const {
-    double M = std::max({ r, g, b }),
-           m = std::min({ r, g, b }),
-           c = M - m,
-           l = .5 * (M + m);
-    double h = c == 0 ? 0 :
-               M == g ? 2 + (b - r) / c :
-               M == b ? 4 + (r - g) / c :
-                        (g < b ? 6 : 0) + (g - b) / c;
-    double s = c == 0 ? 0 : c / (1 - std::fabs(2 * l - 1));
+template<typename T> BasicHSL<T>
+BasicSRGB<T>::hsl() const {
+    T M = std::max({ r, g, b }),
+      m = std::min({ r, g, b }),
+      c = M - m,
+      l = T(.5) * (M + m);
+    T h = hue_of(r, g, b, M, c);
+    T s = c == 0 ? 0 : c / (1 - std::fabs(2 * l - 1));
     return { h, s, l };
 }
 
 
-YCH
-sRGB::luma() const {
-    return YCH::luma(ych().y);
+template<typename T> BasicYCH<T>
+BasicSRGB<T>::luma() const {
+    return BasicYCH<T>::luma(ych().y);
 }
 
 
-YCH
-sRGB::ych() const {
-    double M = std::max({ r, g, b }),
-           m = std::min({ r, g, b }),
-           c = M - m;
-    double y = .2126 * r + .7152 * g + .0722 * b; // Rec. 709 formula
+template<typename T> BasicYCH<T>
+BasicSRGB<T>::ych() const {
+    T M = std::max({ r, g, b }),
+      m = std::min({ r, g, b }),
+      c = M - m;
+    T y = luma_of(r, g, b);
     return { y, c, hue().h };
 }
 
 
-sRGB
-HSL::srgb() const {
-    double c = s * (1 - std::fabs(2 * l - 1));
-    double m = l - c / 2;
-    double r = hue_as_red(h),
-           g = hue_as_red(h - 2),
-           b = hue_as_red(h - 4);
+template<typename T> BasicSRGB<T>
+BasicHSL<T>::srgb() const {
+    T c = s * (1 - std::fabs(2 * l - 1));
+    T m = l - c / 2;
+    T r = hue_as_red(h),
+      g = hue_as_red(h - 2),
+      b = hue_as_red(h - 4);
     return { r * c + m,
              g * c + m,
              b * c + m };
 }
 
 
-sRGB
-YCH::srgb() const {
-    auto v1 = HSL::hue(h).srgb();
-    double y1 = v1.luma().y;
+template<typename T> BasicSRGB<T>
+BasicYCH<T>::srgb() const {
+    auto v1 = BasicHSL<T>::hue(h).srgb();
+    T y1 = v1.luma().y;
     return { (v1.r - y1) * c + y,
              (v1.g - y1) * c + y,
              (v1.b - y1) * c + y };
 }
+
+
+namespace pgamecc {
+namespace color {
+
+template struct BasicRGB<double>;
+template struct BasicSRGB<double>;
+template struct BasicHSL<double>;
+template struct BasicYCH<double>;
+template struct BasicRGB<float>;
+template struct BasicSRGB<float>;
+template struct BasicHSL<float>;
+template struct BasicYCH<float>;
+
+} // color
+} // pgamecc
+
+
+// Fast gamma. pow(x, p) is computed as exp2(p * log2(x)) for positive normal
+// x. Both use plain arithmetic and selects on the bits of the double, so the
+// channel loops below have no calls or branches and can be vectorized.
+
+// c ? x : y on the bits, because compilers move the computation of x or y
+// under a branch, which stops vectorization when floating point may trap
+static inline double
+blend(bool c, double x, double y) {
+    uint64_t mask = -(uint64_t)c, a, b;
+    std::memcpy(&a, &x, sizeof a);
+    std::memcpy(&b, &y, sizeof b);
+    a = a & mask | b & ~mask;
+    std::memcpy(&x, &a, sizeof x);
+    return x;
+}
+
+static inline double
+fast_log2(double x) {
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof bits);
+    // split x = 2^e * m with m in [1, 2); the exponent goes to double
+    // through the bits of 2^52 + exponent, avoiding integer conversions
+    uint64_t field = bits >> 52 & 0x7ff | 0x4330000000000000ull;
+    bits = bits & 0xfffffffffffffull | 0x3ff0000000000000ull;
+    double e, m;
+    std::memcpy(&e, &field, sizeof e);
+    std::memcpy(&m, &bits, sizeof m);
+    e -= 4503599627370496. + 1023;
+
+    // ln(m / sqrt(2)) = 2 atanh(t) with |t| < .172, series to t^11
+    const double sqrt2 = 1.4142135623730950488;
+    double t = (m - sqrt2) / (m + sqrt2), t2 = t * t;
+    double s = 1/11.;
+    s = s * t2 + 1/9.;
+    s = s * t2 + 1/7.;
+    s = s * t2 + 1/5.;
+    s = s * t2 + 1/3.;
+    s = s * t2 + 1;
+    return e + .5 + 2 * t * s * 1.4426950408889634074; // 1/ln(2)
+}
+
+static inline double
+fast_exp2(double y) {
+    // rounding y + 2^52 + 1023 leaves n + 1023 in the low bits; the
+    // exponent is only valid for y in [-1022, 1024), which holds wherever
+    // the gamma functions use the result
+    double biased = y + (4503599627370496. + 1023);
+    double n = biased - (4503599627370496. + 1023);
+    double f = (y - n) * .69314718055994530942;
+    // exp(f) with |f| <= ln(2)/2, series to f^10
+    double s = 1/3628800.;
+    s = s * f + 1/362880.;
+    s = s * f + 1/40320.;
+    s = s * f + 1/5040.;
+    s = s * f + 1/720.;
+    s = s * f + 1/120.;
+    s = s * f + 1/24.;
+    s = s * f + 1/6.;
+    s = s * f + 1/2.;
+    s = s * f + 1;
+    s = s * f + 1;
+    uint64_t bits;
+    std::memcpy(&bits, &biased, sizeof bits);
+    bits <<= 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof scale);
+    return blend(y < 1024, s * scale,
+                 std::numeric_limits<double>::infinity());
+}
+
+static inline double
+fast_gamma_compress(double v) {
+    double p = 1.055 * fast_exp2(fast_log2(v) * (1/2.4)) - .055;
+    return blend(v > .0031308, p, 12.92 * v);
+}
+
+static inline double
+fast_gamma_expand(double v) {
+    double p = fast_exp2(fast_log2((v + .055) / 1.055) * 2.4);
+    return blend(v > .04045, p, v / 12.92);
+}
+
+
+// Pixels are processed as flat arrays of channels, which vectorizes better
+// than going through the structs.
+static_assert(sizeof(RGB) == 3 * sizeof(double) &&
+              sizeof(sRGB) == 3 * sizeof(double),
+              "color structs expected to have no padding");
+
+template<typename In, typename Out>
+static void
+check_sizes(span<In> in, span<Out> out, const char* what) {
+    if (in.size() != out.size())
+        throw std::invalid_argument(std::string(what) + ": sizes differ");
+}
+
+template<typename Func>
+static void
+map_channels(const double* in, double* out, size_t n, Func f) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = f(in[i]);
+}
+
+
+void
+pgamecc::color::to_srgb(span<const RGB> in, span<sRGB> out,
+                        Precision precision)
+{
+    check_sizes(in, out, "color::to_srgb()");
+    auto p = reinterpret_cast<const double*>(in.data());
+    auto q = reinterpret_cast<double*>(out.data());
+    if (precision == Precision::exact)
+        map_channels(p, q, 3 * in.size(), gamma_compress<double>);
+    else
+        map_channels(p, q, 3 * in.size(), fast_gamma_compress);
+}
+
+void
+pgamecc::color::to_rgb(span<const sRGB> in, span<RGB> out,
+                       Precision precision)
+{
+    check_sizes(in, out, "color::to_rgb()");
+    auto p = reinterpret_cast<const double*>(in.data());
+    auto q = reinterpret_cast<double*>(out.data());
+    if (precision == Precision::exact)
+        map_channels(p, q, 3 * in.size(), gamma_expand<double>);
+    else
+        map_channels(p, q, 3 * in.size(), fast_gamma_expand);
+}
+
+void
+pgamecc::color::to_hsl(span<const sRGB> in, span<HSL> out)
+{
+    check_sizes(in, out, "color::to_hsl()");
+    for (size_t i = 0; i < in.size(); i++)
+        out[i] = in[i].hsl();
+}
+
+// same as sRGB::ych(), without going through HSL
+void
+pgamecc::color::to_ych(span<const sRGB> in, span<YCH> out)
+{
+    check_sizes(in, out, "color::to_ych()");
+    for (size_t i = 0; i < in.size(); i++) {
+        double r = in[i].r, g = in[i].g, b = in[i].b;
+        double M = std::max({ r, g, b }),
+               m = std::min({ r, g, b }),
+               c = M - m;
+        out[i] = { luma_of(r, g, b), c, hue_of(r, g, b, M, c) };
+    }
+}
+
+void
+pgamecc::color::to_srgb(span<const HSL> in, span<sRGB> out)
+{
+    check_sizes(in, out, "color::to_srgb()");
+    for (size_t i = 0; i < in.size(); i++)
+        out[i] = in[i].srgb();
+}
+
+// same as YCH::srgb(): the fully saturated hue has chroma 1 and no offset,
+// so it is taken directly and its luma computed once
+void
+pgamecc::color::to_srgb(span<const YCH> in, span<sRGB> out)
+{
+    check_sizes(in, out, "color::to_srgb()");
+    for (size_t i = 0; i < in.size(); i++) {
+        double y = in[i].y, c = in[i].c, h = in[i].h;
+        double r = hue_as_red(h),
+               g = hue_as_red(h - 2),
+               b = hue_as_red(h - 4);
+        double y1 = luma_of(r, g, b);
+        out[i] = { (r - y1) * c + y,
+                   (g - y1) * c + y,
+                   (b - y1) * c + y };
+    }
+}
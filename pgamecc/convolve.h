@@ -0,0 +1,301 @@
+#ifndef PGAMECC_CONVOLVE_H
+#define PGAMECC_CONVOLVE_H
+
+#include <pgamecc/image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace pgamecc {
+
+// Convolution and blur filters. Pixels outside the image are clamped to the
+// nearest edge pixel, same as LinearSampler, so a constant image stays
+// constant. Sums are computed in the sample_type of Color, as in resample().
+//
+// Inner loops run along whole rows over contiguous buffers, which compilers
+// vectorize. Passing Parallel splits rows into bands across threads.
+
+namespace detail {
+
+// row y of image, extended by r clamped pixels on each side
+template<typename Color, typename Sample>
+void
+pad_row(const Image<Color>& image, int y, int r, std::vector<Sample>& out)
+{
+    auto row = image.row(y);
+    int w = row.size();
+    out.resize(w + 2*r);
+    if (!w)
+        return;
+    std::fill(out.begin(), out.begin() + r, row[0]);
+    std::copy(row.begin(), row.end(), out.begin() + r);
+    std::fill(out.end() - r, out.end(), row[w-1]);
+}
+
+inline int
+clamp_index(int i, int n)
+{
+    return std::max(0, std::min(i, n-1));
+}
+
+inline void
+check_kernel(size_t size)
+{
+    if (size % 2 == 0)
+        throw std::invalid_argument("convolve(): kernel size must be odd");
+}
+
+template<typename Color>
+Image<Color>
+convolve_rows(const Image<Color>& image, span<const double> kernel,
+              int threads)
+{
+    typedef sample_type_t<Color> Sample;
+    int r = kernel.size() / 2, w = image.size().x;
+    Image<Color> result(image.size());
+    parallel_bands(image.size().y, threads, [&](int y0, int y1) {
+        std::vector<Sample> in;
+        for (int y = y0; y < y1; y++) {
+            pad_row(image, y, r, in);
+            Color* out = result.row(y).data();
+            for (int x = 0; x < w; x++) {
+                const Sample* p = &in[x];
+                Sample sum = Sample();
+                for (size_t k = 0; k < kernel.size(); k++)
+                    sum = sum + kernel[k] * p[k];
+                out[x] = sum;
+            }
+        }
+    });
+    return result;
+}
+
+template<typename Color>
+Image<Color>
+convolve_columns(const Image<Color>& image, span<const double> kernel,
+                 int threads)
+{
+    typedef sample_type_t<Color> Sample;
+    int r = kernel.size() / 2, w = image.size().x, h = image.size().y;
+    Image<Color> result(image.size());
+    parallel_bands(h, threads, [&](int y0, int y1) {
+        // accumulate whole source rows so the inner loop is contiguous
+        std::vector<Sample> sum(w);
+        for (int y = y0; y < y1; y++) {
+            for (size_t k = 0; k < kernel.size(); k++) {
+                int yk = clamp_index(y + (int)k - r, h);
+                const Color* in = image.row(yk).data();
+                double wk = kernel[k];
+                if (k == 0)
+                    for (int x = 0; x < w; x++)
+                        sum[x] = wk * Sample(in[x]);
+                else
+                    for (int x = 0; x < w; x++)
+                        sum[x] = sum[x] + wk * Sample(in[x]);
+            }
+            std::copy(sum.begin(), sum.end(), result.row(y).begin());
+        }
+    });
+    return result;
+}
+
+// Running sums: each output pixel adds the pixel entering the window and
+// subtracts the one leaving it, so the cost doesn't depend on the radius.
+template<typename Color>
+Image<Color>
+box_rows(const Image<Color>& image, int r, int threads)
+{
+    typedef sample_type_t<Color> Sample;
+    int w = image.size().x;
+    double scale = 1. / (2*r + 1);
+    Image<Color> result(image.size());
+    parallel_bands(image.size().y, threads, [&](int y0, int y1) {
+        std::vector<Sample> in;
+        for (int y = y0; y < y1; y++) {
+            pad_row(image, y, r, in);
+            Color* out = result.row(y).data();
+            Sample sum = Sample();
+            for (int k = 0; k < 2*r; k++)
+                sum = sum + in[k];
+            for (int x = 0; x < w; x++) {
+                sum = sum + in[x + 2*r];
+                out[x] = scale * sum;
+                sum = sum - in[x];
+            }
+        }
+    });
+    return result;
+}
+
+template<typename Color>
+Image<Color>
+box_columns(const Image<Color>& image, int r, int threads)
+{
+    typedef sample_type_t<Color> Sample;
+    int w = image.size().x, h = image.size().y;
+    double scale = 1. / (2*r + 1);
+    Image<Color> result(image.size());
+    parallel_bands(h, threads, [&](int y0, int y1) {
+        // a running sum of whole rows, started afresh in each band
+        std::vector<Sample> sum(w);
+        auto add = [&](int y, double sign) {
+            const Color* in = image.row(clamp_index(y, h)).data();
+            for (int x = 0; x < w; x++)
+                sum[x] = sum[x] + sign * Sample(in[x]);
+        };
+        for (int k = -r; k < r; k++)
+            add(y0 + k, 1);
+        for (int y = y0; y < y1; y++) {
+            add(y + r, 1);
+            Color* out = result.row(y).data();
+            for (int x = 0; x < w; x++)
+                out[x] = scale * sum[x];
+            add(y - r, -1);
+        }
+    });
+    return result;
+}
+
+inline std::vector<double>
+gaussian_kernel(double sigma)
+{
+    if (!(sigma > 0))
+        return { 1 };
+    int r = (int)std::ceil(3 * sigma);
+    std::vector<double> kernel(2*r + 1);
+    double sum = 0;
+    for (int i = -r; i <= r; i++)
+        sum += kernel[i + r] = std::exp(-i*i / (2 * sigma*sigma));
+    for (auto& k: kernel)
+        k /= sum;
+    return kernel;
+}
+
+template<typename Color>
+Image<Color>
+convolve_separable(const Image<Color>& image, span<const double> kernel_x,
+                   span<const double> kernel_y, int threads)
+{
+    check_kernel(kernel_x.size());
+    check_kernel(kernel_y.size());
+    return convolve_columns(convolve_rows(image, kernel_x, threads),
+                            kernel_y, threads);
+}
+
+template<typename Color>
+Image<Color>
+convolve_2d(const Image<Color>& image, const Image<double>& kernel,
+            int threads)
+{
+    typedef sample_type_t<Color> Sample;
+    ivec2 ks = kernel.size();
+    check_kernel(ks.x);
+    check_kernel(ks.y);
+    ivec2 r = ks / 2;
+    int w = image.size().x, h = image.size().y;
+    Image<Color> result(image.size());
+    parallel_bands(h, threads, [&](int y0, int y1) {
+        std::vector<Sample> in, sum(w);
+        for (int y = y0; y < y1; y++) {
+            std::fill(sum.begin(), sum.end(), Sample());
+            for (int ky = 0; ky < ks.y; ky++) {
+                pad_row(image, clamp_index(y + ky - r.y, h), r.x, in);
+                for (int kx = 0; kx < ks.x; kx++) {
+                    // kernel is not flipped, same as separable kernels
+                    double wk = kernel.at_unsafe(ivec2(kx, ky));
+                    if (wk == 0)
+                        continue;
+                    const Sample* p = &in[kx];
+                    for (int x = 0; x < w; x++)
+                        sum[x] = sum[x] + wk * p[x];
+                }
+            }
+            std::copy(sum.begin(), sum.end(), result.row(y).begin());
+        }
+    });
+    return result;
+}
+
+}
+
+// Convolves rows with kernel_x and columns with kernel_y, both of odd size
+// and centered on the pixel. Throws std::invalid_argument for even sizes.
+template<typename Color>
+Image<Color>
+convolve(const Image<Color>& image, span<const double> kernel_x,
+         span<const double> kernel_y)
+{
+    return detail::convolve_separable(image, kernel_x, kernel_y, 1);
+}
+
+template<typename Color>
+Image<Color>
+convolve(const Image<Color>& image, span<const double> kernel_x,
+         span<const double> kernel_y, Parallel parallel)
+{
+    return detail::convolve_separable(image, kernel_x, kernel_y,
+                                      parallel.threads);
+}
+
+// General 2D kernel with odd width and height, centered on the pixel. Cost
+// is proportional to the kernel area, so prefer separable kernels.
+template<typename Color>
+Image<Color>
+convolve(const Image<Color>& image, const Image<double>& kernel)
+{
+    return detail::convolve_2d(image, kernel, 1);
+}
+
+template<typename Color>
+Image<Color>
+convolve(const Image<Color>& image, const Image<double>& kernel,
+         Parallel parallel)
+{
+    return detail::convolve_2d(image, kernel, parallel.threads);
+}
+
+// Gaussian with standard deviation sigma in pixels, cut off at 3 sigma
+template<typename Color>
+Image<Color>
+gaussian_blur(const Image<Color>& image, double sigma)
+{
+    auto kernel = detail::gaussian_kernel(sigma);
+    return detail::convolve_separable(image, kernel, kernel, 1);
+}
+
+template<typename Color>
+Image<Color>
+gaussian_blur(const Image<Color>& image, double sigma, Parallel parallel)
+{
+    auto kernel = detail::gaussian_kernel(sigma);
+    return detail::convolve_separable(image, kernel, kernel,
+                                      parallel.threads);
+}
+
+// Average of the (2 radius + 1)^2 pixels around each pixel, at a constant
+// cost per pixel for any radius.
+template<typename Color>
+Image<Color>
+box_blur(const Image<Color>& image, int radius)
+{
+    if (radius < 0)
+        throw std::invalid_argument("box_blur(): negative radius");
+    return detail::box_columns(detail::box_rows(image, radius, 1), radius, 1);
+}
+
+template<typename Color>
+Image<Color>
+box_blur(const Image<Color>& image, int radius, Parallel parallel)
+{
+    if (radius < 0)
+        throw std::invalid_argument("box_blur(): negative radius");
+    int threads = parallel.threads;
+    return detail::box_columns(detail::box_rows(image, radius, threads),
+                               radius, threads);
+}
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+#include "dirty.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+using std::invalid_argument;
+using std::vector;
+
+using namespace pgamecc;
+
+
+DirtyRegion::DirtyRegion(ivec2 size, int tile) :
+    _size(size), _tile(tile)
+{
+    if (size.x < 0 || size.y < 0 || tile <= 0)
+        throw invalid_argument("DirtyRegion: bad size");
+    tiles = (size + tile-1) / tile;
+    dirty.assign((size_t)tiles.x * tiles.y, 0);
+}
+
+void
+DirtyRegion::mark(irect region)
+{
+    region = region & irect{ivec2(0), _size};
+    if (region.empty())
+        return;
+    // round out to whole tiles
+    ivec2 t0 = region.min / _tile, t1 = (region.max + _tile-1) / _tile;
+    for (int y = t0.y; y < t1.y; y++)
+        std::fill_n(&dirty[(size_t)y * tiles.x + t0.x], t1.x - t0.x, 1);
+}
+
+void
+DirtyRegion::mark_all()
+{
+    std::fill(dirty.begin(), dirty.end(), 1);
+}
+
+void
+DirtyRegion::clear()
+{
+    std::fill(dirty.begin(), dirty.end(), 0);
+}
+
+bool
+DirtyRegion::empty() const
+{
+    return std::find(dirty.begin(), dirty.end(), 1) == dirty.end();
+}
+
+irect
+DirtyRegion::tile_rect(ivec2 t) const
+{
+    return irect{t * _tile, (t+1) * _tile} & irect{ivec2(0), _size};
+}
+
+vector<irect>
+DirtyRegion::rects() const
+{
+    // rectangles in tile coordinates; open ones end at the current row
+    vector<irect> done, open, next;
+    for (int y = 0; y < tiles.y; y++) {
+        const char* row = &dirty[(size_t)y * tiles.x];
+        for (int x = 0; x < tiles.x;) {
+            if (!row[x]) {
+                x++;
+                continue;
+            }
+            int x0 = x;
+            while (x < tiles.x && row[x])
+                x++;
+
+            // extend a run of the same span from the row above
+            auto it = std::find_if(open.begin(), open.end(), [&](irect r) {
+                return r.min.x == x0 && r.max.x == x;
+            });
+            if (it != open.end()) {
+                next.push_back({it->min, ivec2(x, y+1)});
+                open.erase(it);
+            } else
+                next.push_back({ivec2(x0, y), ivec2(x, y+1)});
+        }
+        done.insert(done.end(), open.begin(), open.end());
+        open.swap(next);
+        next.clear();
+    }
+    done.insert(done.end(), open.begin(), open.end());
+
+    for (auto& r: done)
+        r = irect{r.min * _tile, r.max * _tile} & irect{ivec2(0), _size};
+    return done;
+}
+
+vector<irect>
+DirtyRegion::tile_rects() const
+{
+    vector<irect> result;
+    for (int y = 0; y < tiles.y; y++)
+        for (int x = 0; x < tiles.x; x++)
+            if (dirty[(size_t)y * tiles.x + x])
+                result.push_back(tile_rect(ivec2(x, y)));
+    return result;
+}
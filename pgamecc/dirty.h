@@ -0,0 +1,103 @@
+#ifndef PGAMECC_DIRTY_H
+#define PGAMECC_DIRTY_H
+
+#include <pgamecc/image.h>
+
+#include <stdexcept>
+#include <vector>
+
+namespace pgamecc {
+
+// Tracks which parts of an image are out of date, at the granularity of
+// square tiles. Marked rectangles are rounded out to whole tiles, so repeated
+// small edits cost no more than the tiles they touch.
+class DirtyRegion {
+    ivec2 _size;
+    int _tile;
+    ivec2 tiles;
+    std::vector<char> dirty; // per tile, row by row
+
+public:
+    // everything starts clean
+    explicit DirtyRegion(ivec2 size, int tile = 64);
+
+    ivec2 size() const { return _size; }
+    int tile_size() const { return _tile; }
+
+    // parts outside the image are ignored
+    void mark(irect region);
+    void mark(ivec2 pixel) { mark(irect{pixel, pixel + 1}); }
+    void mark_all();
+    void clear();
+
+    bool empty() const;
+
+    // Dirty tiles clipped to the image, merged into as few rectangles as is
+    // easy: runs along tile rows, joined with runs below of the same span.
+    std::vector<irect> rects() const;
+    // each dirty tile separately, for spreading work across threads
+    std::vector<irect> tile_rects() const;
+
+private:
+    irect tile_rect(ivec2 t) const;
+};
+
+namespace detail {
+
+template<typename Color, typename Layout, typename Func>
+void
+remake_image_rects(Image<Color, Layout>& image, const std::vector<irect>& rects,
+                   const Func& f, std::true_type, int threads)
+{
+    auto row = batch_rows<Color>(image.size(), f);
+    parallel_bands(rects.size(), threads, [&](int i0, int i1) {
+        for (int i = i0; i < i1; i++)
+            image.fill(rects[i], row);
+    });
+}
+
+template<typename Color, typename Layout, typename Func>
+void
+remake_image_rects(Image<Color, Layout>& image, const std::vector<irect>& rects,
+                   const Func& f, std::false_type, int threads)
+{
+    ivec2 size = image.size();
+    auto pixel = [&](ivec2 i) { return f(pixel_center(i, size)); };
+    parallel_bands(rects.size(), threads, [&](int i0, int i1) {
+        for (int i = i0; i < i1; i++)
+            image.fill(rects[i], pixel);
+    });
+}
+
+}
+
+// Recomputes the dirty parts of an image made by make_image() with the same
+// size. Functions are called the same way as in make_image(), including batch
+// functions, so unchanged pixels stay identical to a full rebuild.
+template<typename Color, typename Layout, typename Func>
+void
+remake_image(Image<Color, Layout>& image, const DirtyRegion& dirty,
+             const Func& f)
+{
+    if (dirty.size() != image.size())
+        throw std::invalid_argument("DirtyRegion size differs from Image");
+    detail::remake_image_rects(image, dirty.rects(), f,
+        detail::is_callable<Func, void(span<const dvec2>, span<Color>)>{}, 1);
+}
+
+// same as remake_image, with dirty tiles shared between threads
+template<typename Color, typename Layout, typename Func>
+void
+remake_image_parallel(Image<Color, Layout>& image, const DirtyRegion& dirty,
+                      const Func& f, int threads = 0)
+{
+    if (dirty.size() != image.size())
+        throw std::invalid_argument("DirtyRegion size differs from Image");
+    detail::remake_image_rects(image, dirty.tile_rects(), f,
+        detail::is_callable<Func, void(span<const dvec2>, span<Color>)>{},
+        threads);
+}
+
+}
+
+#endif
@@ -1,64 +1,501 @@
 #include "entropy.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
 #include <random>
+#include <sstream>
 #include <stdexcept>
+#include <tuple>
+#include <vector>
 
 #include NOISE_INCLUDE_FILE
 
-using std::mt19937;
 using std::random_device;
-using std::uniform_int_distribution;
-using std::uniform_real_distribution;
-using std::normal_distribution;
-using std::exponential_distribution;
-using std::poisson_distribution;
 using std::domain_error;
 
 using namespace pgamecc;
+using entropy::Generator;
+using entropy::BulkGenerator;
+
+
+//
+// entropy::Generator
+//
+
+static uint64_t
+splitmix64(uint64_t& x) {
+    uint64_t z = x += 0x9e3779b97f4a7c15ull;
+    z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ z >> 27) * 0x94d049bb133111ebull;
+    return z ^ z >> 31;
+}
+
+Generator::Generator(uint64_t seed)
+{
+    // splitmix64 never gives an all-zero state
+    for (auto& x: s)
+        x = splitmix64(seed);
+}
+
+Generator::Generator(uint64_t seed, uint64_t stream) :
+    Generator(seed ^ splitmix64(stream))
+{}
+
+void
+Generator::jump()
+{
+    static const uint64_t polynomial[] = {
+        0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull,
+        0xa9582618e03fc9aaull, 0x39abdc4529b1661cull
+    };
+    uint64_t t[4] = {};
+    for (uint64_t p: polynomial)
+        for (int b = 0; b < 64; b++) {
+            if (p >> b & 1)
+                for (int i = 0; i < 4; i++)
+                    t[i] ^= s[i];
+            (*this)();
+        }
+    for (int i = 0; i < 4; i++)
+        s[i] = t[i];
+}
+
+Generator
+Generator::split()
+{
+    Generator result = *this;
+    jump();
+    return result;
+}
+
+// Lemire's multiply-shift, rejecting the few values that would bias it
+int
+Generator::dice(int max) {
+    if (max <= 0)
+        throw domain_error("dice(max): max must be positive");
+    uint32_t range = max;
+    uint64_t m = ((*this)() >> 32) * range;
+    if ((uint32_t)m < range) {
+        uint32_t threshold = -range % range;
+        while ((uint32_t)m < threshold)
+            m = ((*this)() >> 32) * range;
+    }
+    return m >> 32;
+}
+
+// Marsaglia's polar method, using one of the two values
+double
+Generator::normal() {
+    double u, v, r;
+    do {
+        u = 2 * uniform() - 1;
+        v = 2 * uniform() - 1;
+        r = u*u + v*v;
+    } while (r >= 1 || r == 0);
+    return u * std::sqrt(-2 * std::log(r) / r);
+}
+
+double
+Generator::exp(double lambda) {
+    return -std::log1p(-uniform()) / lambda;
+}
+
+double
+Generator::trunc_exp(double lambda, double cutoff) {
+    if (cutoff <= 0)
+        throw domain_error("trunc_exp(): cutoff must be positive");
+    auto c = std::exp(cutoff * -lambda);
+    return std::log(c + (1-c)*uniform())/-lambda;
+}
+
+// log(k!), exact for small k and from Stirling's series otherwise, where
+// the first omitted term is below 1e-10; std::lgamma() may write signgam,
+// which isn't safe with draws on several threads
+static double
+log_factorial(int k) {
+    if (k < 10) {
+        double f = 1;
+        for (int i = 2; i <= k; i++)
+            f *= i;
+        return std::log(f);
+    }
+    double x = k + 1, r = 1 / x, r2 = r * r;
+    return (x - .5) * std::log(x) - x + .91893853320467274178 +
+        r * (1./12 - r2 * (1./360 - r2 / 1260));
+}
+
+// Inversion for small means, as in BulkGenerator::poisson(), and Hormann's
+// transformed rejection with squeeze (PTRS) for large ones, which takes
+// little more than one pair of uniform draws whatever the mean
+int
+Generator::poisson(double mean) {
+    if (!(mean > 0))
+        throw domain_error("poisson(): mean must be positive");
+
+    if (mean < 10) {
+        double u = uniform(), p = std::exp(-mean), c = p;
+        int k = 0;
+        while (u >= c && p > 0) {
+            k++;
+            p *= mean / k;
+            c += p;
+        }
+        return k;
+    }
+
+    double log_mean = std::log(mean);
+    double b = .931 + 2.53 * std::sqrt(mean);
+    double a = -.059 + .02483 * b;
+    double log_alpha = std::log(1.1239 + 1.1328 / (b - 3.4));
+    double vr = .9277 - 3.6224 / (b - 2);
+    for (;;) {
+        double u = uniform() - .5, v = uniform();
+        double us = .5 - std::abs(u);
+        int k = std::floor((2 * a / us + b) * u + mean + .43);
+        if (us >= .07 && v <= vr)
+            return k;
+        if (k < 0 || (us < .013 && v > us))
+            continue;
+        if (std::log(v) + log_alpha - std::log(a / (us * us) + b) <=
+            -mean + k * log_mean - log_factorial(k))
+            return k;
+    }
+}
+
+
+//
+// entropy::BulkGenerator
+//
+
+// Marsaglia and Tsang's ziggurat with 128 layers, laid out as by Doornik:
+// x[i] are the layer edges and ratio[i] = x[i+1] / x[i] the part of layer i
+// that is accepted without further checks
+namespace {
+struct Ziggurat {
+    static constexpr int layers = 128;
+    static constexpr double r = 3.442619855899, v = 9.91256303526217e-3;
+    double x[layers + 1], ratio[layers];
+
+    Ziggurat() {
+        double f = std::exp(-.5 * r * r);
+        x[0] = v / f;
+        x[1] = r;
+        x[layers] = 0;
+        for (int i = 2; i < layers; i++) {
+            x[i] = std::sqrt(-2 * std::log(v / x[i-1] + f));
+            f = std::exp(-.5 * x[i] * x[i]);
+        }
+        for (int i = 0; i < layers; i++)
+            ratio[i] = x[i+1] / x[i];
+    }
+};
+const Ziggurat zig;
+}
+
+// [0, 1) from the top 52 bits, through the bits of a double in [1, 2),
+// which vectorizes where integer to double conversion doesn't
+static inline double
+unit(uint64_t bits) {
+    bits = bits >> 12 | 0x3ff0000000000000ull;
+    double d;
+    std::memcpy(&d, &bits, sizeof d);
+    return d - 1;
+}
+
+BulkGenerator::BulkGenerator(uint64_t seed) :
+    extra(seed)
+{
+    for (int j = 0; j < lanes; j++) {
+        uint64_t x = extra();
+        for (auto& word: s)
+            word[j] = splitmix64(x);
+    }
+}
+
+BulkGenerator::BulkGenerator(Generator& g) :
+    BulkGenerator(g())
+{}
+
+// Fills out a draw of each lane at a time. fast(bits, value) makes a value
+// from the bits of a draw, or returns false where slow(bits) must make it
+// instead. The tail of out takes part of the last draws. The lanes are
+// stepped as in Generator::operator(), with the multiplications as shifts,
+// in locals that compilers keep in registers, and each draw is used where
+// it is made; going through memory in between costs half the speed.
+template<typename T, typename Fast, typename Slow>
+void
+BulkGenerator::fill(span<T> out, Fast fast, Slow slow)
+{
+    uint64_t s0[lanes], s1[lanes], s2[lanes], s3[lanes];
+    for (int j = 0; j < lanes; j++)
+        s0[j] = s[0][j], s1[j] = s[1][j], s2[j] = s[2][j], s3[j] = s[3][j];
+
+    T tail[lanes];
+    for (size_t i = 0; i < out.size(); i += lanes) {
+        T* o = i + lanes <= out.size() ? &out[i] : tail;
+        uint64_t bits[lanes];
+        bool ok[lanes];
+        for (int j = 0; j < lanes; j++) {
+            uint64_t x = s1[j] + (s1[j] << 2);
+            x = x << 7 | x >> 57;
+            bits[j] = x + (x << 3);
+            uint64_t t = s1[j] << 17;
+            s2[j] ^= s0[j];
+            s3[j] ^= s1[j];
+            s1[j] ^= s2[j];
+            s0[j] ^= s3[j];
+            s2[j] ^= t;
+            s3[j] = s3[j] << 45 | s3[j] >> 19;
+            ok[j] = fast(bits[j], o[j]);
+        }
+        for (int j = 0; j < lanes; j++)
+            if (!ok[j])
+                o[j] = slow(bits[j]);
+        if (o == tail)
+            std::copy(tail, tail + (out.size() - i), &out[i]);
+    }
+
+    for (int j = 0; j < lanes; j++)
+        s[0][j] = s0[j], s[1][j] = s1[j], s[2][j] = s2[j], s[3][j] = s3[j];
+}
+
+// f makes every value directly
+template<typename T, typename Func>
+void
+BulkGenerator::fill(span<T> out, Func f)
+{
+    fill(out, [&](uint64_t bits, T& value) { value = f(bits); return true; },
+              [](uint64_t) { return T(); });
+}
+
+void
+BulkGenerator::bits(span<uint64_t> out)
+{
+    fill(out, [](uint64_t bits) { return bits; });
+}
+
+void
+BulkGenerator::uniform(span<double> out)
+{
+    fill(out, [](uint64_t bits) { return unit(bits); });
+}
+
+// the rest of Doornik's ziggurat, for the 1.2% of draws outside the core of
+// their layer
+static double
+normal_slow(Generator& g, double u, int i) {
+    for (;;) {
+        if (i == 0) {
+            // tail beyond r
+            double x, y;
+            do {
+                x = std::log(1 - g.uniform()) / Ziggurat::r;
+                y = std::log(1 - g.uniform());
+            } while (-2 * y < x * x);
+            return u < 0 ? x - Ziggurat::r : Ziggurat::r - x;
+        }
+        double x = u * zig.x[i];
+        double f0 = std::exp(-.5 * (zig.x[i] * zig.x[i] - x * x)),
+               f1 = std::exp(-.5 * (zig.x[i+1] * zig.x[i+1] - x * x));
+        if (f1 + g.uniform() * (f0 - f1) < 1)
+            return x;
+
+        uint64_t bits = g();
+        u = 2 * unit(bits) - 1;
+        i = bits & (Ziggurat::layers - 1);
+        if (std::fabs(u) < zig.ratio[i])
+            return u * zig.x[i];
+    }
+}
+
+void
+BulkGenerator::normal(span<double> out)
+{
+    // the layer comes from the low bits and u from the high bits
+    auto layer = [](uint64_t bits) {
+        return int(bits & (Ziggurat::layers - 1));
+    };
+    fill(out, [&](uint64_t bits, double& value) {
+        int i = layer(bits);
+        double u = 2 * unit(bits) - 1;
+        value = u * zig.x[i];
+        return std::fabs(u) < zig.ratio[i];
+    }, [&](uint64_t bits) {
+        return normal_slow(extra, 2 * unit(bits) - 1, layer(bits));
+    });
+}
+
+void
+BulkGenerator::exp(span<double> out, double lambda)
+{
+    fill(out, [&](uint64_t bits) {
+        return -std::log(1 - unit(bits)) / lambda;
+    });
+}
+
+void
+BulkGenerator::poisson(span<int> out, double mean)
+{
+    if (!(mean > 0))
+        throw domain_error("poisson(): mean must be positive");
+
+    // large means take many steps of inversion, so they go through the
+    // rejection method of Generator::poisson()
+    if (mean >= 16) {
+        for (auto& o: out)
+            o = extra.poisson(mean);
+        return;
+    }
+
+    // inversion: count the steps of the cumulative distribution below u
+    double p0 = std::exp(-mean);
+    fill(out, [&](uint64_t bits) {
+        double u = unit(bits), p = p0, c = p0;
+        int k = 0;
+        while (u >= c && p > 0) {
+            k++;
+            p *= mean / k;
+            c += p;
+        }
+        return k;
+    });
+}
+
+void
+BulkGenerator::dice(span<int> out, int max)
+{
+    if (max <= 0)
+        throw domain_error("dice(max): max must be positive");
+    // as Generator::dice() on each lane, redrawing rejects from extra
+    uint32_t range = max, threshold = -range % range;
+    fill(out, [&](uint64_t bits, int& value) {
+        uint64_t m = (bits >> 32) * range;
+        value = m >> 32;
+        return (uint32_t)m >= threshold;
+    }, [&](uint64_t) {
+        return extra.dice(max);
+    });
+}
+
+
+//
+// per-thread generator
+//
 
 namespace {
-// TODO: put some preconstructed distributions in class together with generator
-thread_local mt19937 gen{random_device()()};
+thread_local Generator gen{(uint64_t)random_device()() << 32 ^
+                           random_device()()};
+}
+
+Generator&
+entropy::generator() {
+    return gen;
+}
+
+void
+entropy::seed(uint64_t seed) {
+    gen = Generator(seed);
 }
 
 bool
 entropy::coin() {
-    return uniform_int_distribution<int>(0, 1)(gen);
+    return gen.coin();
 }
 
 int
 entropy::dice(int max) {
-    if (max <= 0)
-        throw domain_error("dice(max): max must be positive");
-    return uniform_int_distribution<int>(0, max-1)(gen);
+    return gen.dice(max);
 }
 
 double
 entropy::uniform() {
-    return uniform_real_distribution<double>(0, 1)(gen);
+    return gen.uniform();
 }
 
 double
 entropy::normal() {
-    return normal_distribution<double>(0, 1)(gen);
+    return gen.normal();
 }
 
 double
 entropy::exp(double lambda) {
-    return exponential_distribution<double>(lambda)(gen);
+    return gen.exp(lambda);
 }
 
 double
 entropy::trunc_exp(double lambda, double cutoff) {
-    if (cutoff <= 0)
-        throw domain_error("trunc_exp(): cutoff must be positive");
-    auto c = std::exp(cutoff * -lambda);
-    return std::log(c + (1-c)*uniform())/-lambda;
+    return gen.trunc_exp(lambda, cutoff);
 }
 
 int
 entropy::poisson(double mean) {
-    return poisson_distribution<int>(mean)(gen);
+    return gen.poisson(mean);
+}
+
+
+void
+entropy::fill_dice(span<int> out, int max) {
+    BulkGenerator(gen).dice(out, max);
+}
+
+void
+entropy::fill_uniform(span<double> out) {
+    BulkGenerator(gen).uniform(out);
+}
+
+void
+entropy::fill_normal(span<double> out) {
+    BulkGenerator(gen).normal(out);
+}
+
+void
+entropy::fill_exp(span<double> out, double lambda) {
+    BulkGenerator(gen).exp(out, lambda);
+}
+
+void
+entropy::fill_poisson(span<int> out, double mean) {
+    BulkGenerator(gen).poisson(out, mean);
+}
+
+
+// Grids of noise are filled row by row on parallel.threads threads, with
+// row(y, out) computing row y.
+template<typename T, typename Row>
+static void
+fill_rows(Image<T>& image, Parallel parallel, const Row& row) {
+    parallel_bands(image.size().y, parallel.threads, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++)
+            row(y, image.row(y));
+    });
+}
+
+static dvec2
+grid_point(dvec2 origin, dvec2 step, double x, double y) {
+    return origin + dvec2(x, y) * step;
+}
+
+template<typename Vec>
+static Vec
+grid_point(Vec origin, Vec dx, Vec dy, double x, double y) {
+    return origin + x * dx + y * dy;
+}
+
+// the index of the only nonzero coordinate, or -1
+template<int D, typename Vec>
+static int
+only_axis(Vec v) {
+    int axis = -1;
+    for (int d = 0; d < D; d++)
+        if (v[d] != 0) {
+            if (axis >= 0)
+                return -1;
+            axis = d;
+        }
+    return axis;
 }
 
 
@@ -75,7 +512,13 @@ void PerlinNoise::set_octaves(int v) { p->SetOctaveCount(v); }
 void
 PerlinNoise::reseed()
 {
-    p->SetSeed(gen());
+    reseed(gen);
+}
+
+void
+PerlinNoise::reseed(entropy::Generator& g)
+{
+    p->SetSeed(g() >> 33);
 }
 
 double
@@ -91,6 +534,28 @@ PerlinNoise::operator()(dvec3 v) const
     return p->GetValue(v.x, v.y, v.z);
 }
 
+// libnoise modules only read their settings, so rows can be filled
+// concurrently
+void
+PerlinNoise::fill(Image<double>& image, dvec2 origin, dvec2 step,
+                  Parallel parallel) const
+{
+    fill_rows(image, parallel, [&](int y, span<double> row) {
+        for (size_t x = 0; x < row.size(); x++)
+            row[x] = (*this)(grid_point(origin, step, x, y));
+    });
+}
+
+void
+PerlinNoise::fill(Image<double>& image, dvec3 origin, dvec3 dx, dvec3 dy,
+                  Parallel parallel) const
+{
+    fill_rows(image, parallel, [&](int y, span<double> row) {
+        for (size_t x = 0; x < row.size(); x++)
+            row[x] = (*this)(grid_point(origin, dx, dy, x, y));
+    });
+}
+
 
 struct RidgedNoise::impl : noise::module::RidgedMulti {};
 
@@ -104,7 +569,13 @@ void RidgedNoise::set_octaves(int v) { p->SetOctaveCount(v); }
 void
 RidgedNoise::reseed()
 {
-    p->SetSeed(gen());
+    reseed(gen);
+}
+
+void
+RidgedNoise::reseed(entropy::Generator& g)
+{
+    p->SetSeed(g() >> 33);
 }
 
 double
@@ -119,3 +590,1694 @@ RidgedNoise::operator()(dvec3 v) const
 {
     return p->GetValue(v.x, v.y, v.z);
 }
+
+void
+RidgedNoise::fill(Image<double>& image, dvec2 origin, dvec2 step,
+                  Parallel parallel) const
+{
+    fill_rows(image, parallel, [&](int y, span<double> row) {
+        for (size_t x = 0; x < row.size(); x++)
+            row[x] = (*this)(grid_point(origin, step, x, y));
+    });
+}
+
+void
+RidgedNoise::fill(Image<double>& image, dvec3 origin, dvec3 dx, dvec3 dy,
+                  Parallel parallel) const
+{
+    fill_rows(image, parallel, [&](int y, span<double> row) {
+        for (size_t x = 0; x < row.size(); x++)
+            row[x] = (*this)(grid_point(origin, dx, dy, x, y));
+    });
+}
+
+
+//
+// GradientNoise
+//
+
+// for uses by reference, e.g. std::min(), in unoptimized builds
+constexpr int GradientNoise::lanes;
+
+namespace {
+
+const int lanes = GradientNoise::lanes;
+const int max_octaves = 30; // same limit as libnoise
+
+// Lattice points of one octave for simplex noise, as cells and offsets in
+// them, lane by lane. Cells are uint32_t so that neighbors wrap around instead
+// of overflowing.
+struct Lattice {
+    uint32_t cell[3][lanes];
+    float offset[3][lanes];
+};
+
+// Selects and sign changes on the bits, because compilers move the
+// arithmetic of a ternary under a branch, which stops vectorization when
+// floating point may trap. c is a mask of all ones or all zeros.
+template<typename T, typename Bits>
+inline T
+blend(Bits c, T x, T y) {
+    static_assert(sizeof(T) == sizeof(Bits), "mask must match the value");
+    Bits a, b;
+    std::memcpy(&a, &x, sizeof a);
+    std::memcpy(&b, &y, sizeof b);
+    a = a & c | b & ~c;
+    std::memcpy(&x, &a, sizeof x);
+    return x;
+}
+
+// x with its sign flipped if bit is 1
+inline float
+flip(float x, uint32_t bit) {
+    uint32_t a;
+    std::memcpy(&a, &x, sizeof a);
+    a ^= bit << 31;
+    std::memcpy(&x, &a, sizeof x);
+    return x;
+}
+
+template<typename Bits = uint32_t>
+inline Bits
+mask(bool c) {
+    return -(Bits)c;
+}
+
+// Rounding goes through the bits too, since compilers don't vectorize
+// std::floor and std::trunc unless floating point may not trap. Adding
+// 1.5 * 2^52 rounds to the nearest integer, which ends up in the low bits.
+const double round_magic = 6755399441055744.;
+
+inline uint64_t
+bits_of(double x) {
+    uint64_t a;
+    std::memcpy(&a, &x, sizeof a);
+    return a;
+}
+
+// |x| with the sign of y
+inline double
+with_sign(double x, double y) {
+    uint64_t a = bits_of(x) & ~(1ull << 63) | bits_of(y) & 1ull << 63;
+    std::memcpy(&x, &a, sizeof x);
+    return x;
+}
+
+// for |x| < 2^51, which wrap() ensures
+inline double
+round_down(double x) {
+    double r = x + round_magic - round_magic;
+    return r - blend(mask<uint64_t>(r > x), 1., 0.);
+}
+
+// round_magic is only exact below 2^51, so |x| is rounded with 2^52: the
+// sums then lie where doubles are spaced by 1, which makes the rounding exact
+// below 2^52, and doubles from 2^52 on are integers already
+inline double
+round_to_zero(double x) {
+    const double magic = 4503599627370496.;
+    double a = std::fabs(x), r = a + magic - magic;
+    r -= blend(mask<uint64_t>(r > a), 1., 0.);
+    return with_sign(blend(mask<uint64_t>(a < magic), r, a), x);
+}
+
+// as libnoise's MakeInt32Range, keeps cells within int32_t; the remainder
+// is exact, as with std::fmod, since 2^30 is a power of two
+inline double
+wrap(double n) {
+    const double m = 1073741824.;
+    double r = n - round_to_zero(n * (1 / m)) * m;
+    return blend(mask<uint64_t>(std::fabs(n) >= m), 2 * r - with_sign(m, n), n);
+}
+
+// Lattice points are hashed from the seed and a term per axis, with integer
+// multiply and shift, which vectorize. The terms only depend on one
+// coordinate, so they can be shared along rows of a grid.
+const uint32_t hash_multiplier[3] = { 0x8da6b343u, 0xd8163841u, 0xcb1ab31fu };
+
+inline uint32_t
+mix_hash(uint32_t h) {
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+inline uint32_t
+lattice_hash(uint32_t x, uint32_t y, uint32_t z, uint32_t seed) {
+    return mix_hash(seed ^ x * hash_multiplier[0] ^ y * hash_multiplier[1] ^
+                    z * hash_multiplier[2]);
+}
+
+inline float
+fade(float t) {
+    return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+// derivative of fade()
+inline float
+fade_slope(float t) {
+    return 30 * t * t * (t * (t - 2) + 1);
+}
+
+inline float
+lerp(float a, float b, float t) {
+    return a + (b - a) * t;
+}
+
+inline float
+bilerp(float a, float b, float c, float d, float u, float v) {
+    return lerp(lerp(a, b, u), lerp(c, d, u), v);
+}
+
+// 8 gradients (±1, ±2) and (±2, ±1)
+inline float
+grad2(uint32_t h, float x, float y) {
+    uint32_t swap = mask(h & 4);
+    float u = blend(swap, y, x), v = blend(swap, x, y);
+    return flip(u, h & 1) + flip(2 * v, h >> 1 & 1);
+}
+
+// Perlin's 12 edge gradients, 4 of them twice
+inline float
+grad3(uint32_t h, float x, float y, float z) {
+    h &= 15;
+    float u = blend(mask(h < 8), x, y),
+          v = blend(mask(h < 4), y, blend(mask(h == 12 | h == 14), x, z));
+    return flip(u, h & 1) + flip(v, h >> 1 & 1);
+}
+
+// the gradient vectors that grad2() and grad3() take the dot product with
+inline void
+grad2_vector(uint32_t h, float& gx, float& gy) {
+    uint32_t swap = mask(h & 4);
+    float u = flip(1, h & 1), v = flip(2, h >> 1 & 1);
+    gx = blend(swap, v, u);
+    gy = blend(swap, u, v);
+}
+
+inline void
+grad3_vector(uint32_t h, float& gx, float& gy, float& gz) {
+    h &= 15;
+    float u = flip(1, h & 1), v = flip(1, h >> 1 & 1);
+    uint32_t ux = mask(h < 8), vy = mask(h < 4),
+             vx = ~vy & mask(h == 12 | h == 14), vz = ~vy & ~vx;
+    gx = blend(ux, u, 0.f) + blend(vx, v, 0.f);
+    gy = blend(ux, 0.f, u) + blend(vy, v, 0.f);
+    gz = blend(vz, v, 0.f);
+}
+
+// Scales bring one octave to about the spread of libnoise's gradient noise,
+// which is mostly within [-1, 1].
+const float perlin2_scale = .857f, perlin3_scale = 1.43f,
+            simplex2_scale = 34, simplex3_scale = 76;
+
+// The square or cubic lattice of Perlin noise, axis by axis: hash terms of
+// the cells below and above each coordinate, offsets in the cells and their
+// fades. Grids compute an axis once for a row or column and copy it.
+struct PerlinAxis {
+    uint32_t hash[2][lanes];
+    float offset[lanes], fade[lanes];
+};
+
+struct PerlinLattice {
+    PerlinAxis axis[3];
+};
+
+// lane j of the lattice along axis d at x, already multiplied by the
+// frequency
+inline void
+perlin_axis(PerlinAxis& l, int d, int j, double x) {
+    x = wrap(x);
+    double f = round_down(x);
+    uint32_t cell = (int32_t)f;
+    float offset = x - f;
+    l.hash[0][j] = cell * hash_multiplier[d];
+    l.hash[1][j] = (cell + 1) * hash_multiplier[d];
+    l.offset[j] = offset;
+    l.fade[j] = fade(offset);
+}
+
+template<int D, int N>
+void
+perlin_lattice(const double (&p)[D][lanes], double frequency,
+               PerlinLattice& l) {
+    for (int d = 0; d < D; d++)
+        for (int j = 0; j < N; j++)
+            perlin_axis(l.axis[d], d, j, p[d][j] * frequency);
+}
+
+template<int N>
+void
+perlin2(const PerlinLattice& l, uint32_t seed, float* out) {
+    auto &X = l.axis[0], &Y = l.axis[1];
+    for (int j = 0; j < N; j++) {
+        uint32_t X0 = seed ^ X.hash[0][j], X1 = seed ^ X.hash[1][j],
+                 Y0 = Y.hash[0][j], Y1 = Y.hash[1][j];
+        float x = X.offset[j], y = Y.offset[j];
+        float n00 = grad2(mix_hash(X0 ^ Y0), x,     y),
+              n10 = grad2(mix_hash(X1 ^ Y0), x - 1, y),
+              n01 = grad2(mix_hash(X0 ^ Y1), x,     y - 1),
+              n11 = grad2(mix_hash(X1 ^ Y1), x - 1, y - 1);
+        float u = X.fade[j], v = Y.fade[j];
+        out[j] = perlin2_scale * lerp(lerp(n00, n10, u), lerp(n01, n11, u), v);
+    }
+}
+
+template<int N>
+void
+perlin3(const PerlinLattice& l, uint32_t seed, float* out) {
+    auto &X = l.axis[0], &Y = l.axis[1], &Z = l.axis[2];
+    for (int j = 0; j < N; j++) {
+        uint32_t X0 = seed ^ X.hash[0][j], X1 = seed ^ X.hash[1][j],
+                 Y0 = Y.hash[0][j], Y1 = Y.hash[1][j],
+                 Z0 = Z.hash[0][j], Z1 = Z.hash[1][j];
+        float x = X.offset[j], y = Y.offset[j], z = Z.offset[j];
+        float x1 = x - 1, y1 = y - 1, z1 = z - 1;
+        float n000 = grad3(mix_hash(X0 ^ Y0 ^ Z0), x,  y,  z),
+              n100 = grad3(mix_hash(X1 ^ Y0 ^ Z0), x1, y,  z),
+              n010 = grad3(mix_hash(X0 ^ Y1 ^ Z0), x,  y1, z),
+              n110 = grad3(mix_hash(X1 ^ Y1 ^ Z0), x1, y1, z),
+              n001 = grad3(mix_hash(X0 ^ Y0 ^ Z1), x,  y,  z1),
+              n101 = grad3(mix_hash(X1 ^ Y0 ^ Z1), x1, y,  z1),
+              n011 = grad3(mix_hash(X0 ^ Y1 ^ Z1), x,  y1, z1),
+              n111 = grad3(mix_hash(X1 ^ Y1 ^ Z1), x1, y1, z1);
+        float u = X.fade[j], v = Y.fade[j], w = Z.fade[j];
+        out[j] = perlin3_scale *
+            lerp(lerp(lerp(n000, n100, u), lerp(n010, n110, u), v),
+                 lerp(lerp(n001, n101, u), lerp(n011, n111, u), v), w);
+    }
+}
+
+// Cells of the skewed lattice and offsets from their first corner, in the
+// unskewed space, for simplex noise. Skewing is done in double, so that
+// offsets stay exact far from the origin.
+template<int D, int N>
+void
+simplex_lattice(const double (&p)[D][lanes], double frequency, Lattice& l) {
+    const double skew = D == 2 ? .36602540378443865 : 1/3.,   // (√(D+1)-1)/D
+                 unskew = D == 2 ? .21132486540518712 : 1/6.; // (1-1/√(D+1))/D
+    for (int j = 0; j < N; j++) {
+        double x[D], s = 0, t = 0;
+        for (int d = 0; d < D; d++) {
+            x[d] = wrap(p[d][j] * frequency);
+            s += x[d];
+        }
+        s *= skew;
+        double c[D];
+        for (int d = 0; d < D; d++) {
+            c[d] = round_down(x[d] + s);
+            t += c[d];
+        }
+        t *= unskew;
+        for (int d = 0; d < D; d++) {
+            l.cell[d][j] = (int32_t)c[d];
+            l.offset[d][j] = x[d] - (c[d] - t);
+        }
+    }
+}
+
+inline float
+falloff(float t) {
+    t = blend(mask(t > 0), t, 0.f);
+    t *= t;
+    return t * t;
+}
+
+template<int N>
+void
+simplex2(const Lattice& l, uint32_t seed, float* out) {
+    const float g = .21132486540518712f;
+    for (int j = 0; j < N; j++) {
+        uint32_t X = l.cell[0][j], Y = l.cell[1][j];
+        float x0 = l.offset[0][j], y0 = l.offset[1][j];
+        // the middle corner steps along the larger offset
+        int32_t i1 = x0 > y0, j1 = 1 - i1;
+        float x1 = x0 - i1 + g,     y1 = y0 - j1 + g,
+              x2 = x0 - 1 + 2 * g,  y2 = y0 - 1 + 2 * g;
+        float n0 = falloff(.5f - x0*x0 - y0*y0) *
+                   grad2(lattice_hash(X, Y, 0, seed), x0, y0),
+              n1 = falloff(.5f - x1*x1 - y1*y1) *
+                   grad2(lattice_hash(X + i1, Y + j1, 0, seed), x1, y1),
+              n2 = falloff(.5f - x2*x2 - y2*y2) *
+                   grad2(lattice_hash(X + 1, Y + 1, 0, seed), x2, y2);
+        out[j] = simplex2_scale * (n0 + n1 + n2);
+    }
+}
+
+template<int N>
+void
+simplex3(const Lattice& l, uint32_t seed, float* out) {
+    const float g = 1/6.f;
+    for (int j = 0; j < N; j++) {
+        uint32_t X = l.cell[0][j], Y = l.cell[1][j], Z = l.cell[2][j];
+        float x0 = l.offset[0][j], y0 = l.offset[1][j], z0 = l.offset[2][j];
+        // the corners step along the offsets from largest to smallest
+        int32_t xy = x0 >= y0, yz = y0 >= z0, xz = x0 >= z0;
+        int32_t i1 = xy & xz, j1 = (1 - xy) & yz, k1 = (1 - xz) & (1 - yz),
+                 i2 = xy | xz, j2 = (1 - xy) | yz, k2 = 1 - (xz & yz);
+        float x1 = x0 - i1 + g,     y1 = y0 - j1 + g,     z1 = z0 - k1 + g,
+              x2 = x0 - i2 + 2 * g, y2 = y0 - j2 + 2 * g, z2 = z0 - k2 + 2 * g,
+              x3 = x0 - 1 + 3 * g,  y3 = y0 - 1 + 3 * g,  z3 = z0 - 1 + 3 * g;
+        float n0 = falloff(.5f - x0*x0 - y0*y0 - z0*z0) *
+                   grad3(lattice_hash(X, Y, Z, seed), x0, y0, z0),
+              n1 = falloff(.5f - x1*x1 - y1*y1 - z1*z1) *
+                   grad3(lattice_hash(X + i1, Y + j1, Z + k1, seed),
+                         x1, y1, z1),
+              n2 = falloff(.5f - x2*x2 - y2*y2 - z2*z2) *
+                   grad3(lattice_hash(X + i2, Y + j2, Z + k2, seed),
+                         x2, y2, z2),
+              n3 = falloff(.5f - x3*x3 - y3*y3 - z3*z3) *
+                   grad3(lattice_hash(X + 1, Y + 1, Z + 1, seed), x3, y3, z3);
+        out[j] = simplex3_scale * (n0 + n1 + n2 + n3);
+    }
+}
+
+// The kernels with gradients give the same values as those above, and the
+// gradients with respect to the lattice coordinates in g.
+
+template<int N>
+void
+perlin2_gradient(const PerlinLattice& l, uint32_t seed, float* out,
+                 float (*g)[lanes]) {
+    auto &X = l.axis[0], &Y = l.axis[1];
+    for (int j = 0; j < N; j++) {
+        uint32_t X0 = seed ^ X.hash[0][j], X1 = seed ^ X.hash[1][j],
+                 Y0 = Y.hash[0][j], Y1 = Y.hash[1][j];
+        uint32_t h00 = mix_hash(X0 ^ Y0), h10 = mix_hash(X1 ^ Y0),
+                 h01 = mix_hash(X0 ^ Y1), h11 = mix_hash(X1 ^ Y1);
+        float x = X.offset[j], y = Y.offset[j];
+        float n00 = grad2(h00, x,     y),
+              n10 = grad2(h10, x - 1, y),
+              n01 = grad2(h01, x,     y - 1),
+              n11 = grad2(h11, x - 1, y - 1);
+        float x00, y00, x10, y10, x01, y01, x11, y11;
+        grad2_vector(h00, x00, y00);
+        grad2_vector(h10, x10, y10);
+        grad2_vector(h01, x01, y01);
+        grad2_vector(h11, x11, y11);
+        float u = X.fade[j], v = Y.fade[j];
+        out[j] = perlin2_scale * bilerp(n00, n10, n01, n11, u, v);
+        // the corners' gradients interpolated, and the slopes of the fades
+        g[0][j] = perlin2_scale * (bilerp(x00, x10, x01, x11, u, v) +
+            fade_slope(x) * lerp(n10 - n00, n11 - n01, v));
+        g[1][j] = perlin2_scale * (bilerp(y00, y10, y01, y11, u, v) +
+            fade_slope(y) * (lerp(n01, n11, u) - lerp(n00, n10, u)));
+    }
+}
+
+template<int N>
+void
+perlin3_gradient(const PerlinLattice& l, uint32_t seed, float* out,
+                 float (*g)[lanes]) {
+    auto &X = l.axis[0], &Y = l.axis[1], &Z = l.axis[2];
+    for (int j = 0; j < N; j++) {
+        uint32_t X0 = seed ^ X.hash[0][j], X1 = seed ^ X.hash[1][j],
+                 Y0 = Y.hash[0][j], Y1 = Y.hash[1][j],
+                 Z0 = Z.hash[0][j], Z1 = Z.hash[1][j];
+        uint32_t h000 = mix_hash(X0 ^ Y0 ^ Z0), h100 = mix_hash(X1 ^ Y0 ^ Z0),
+                 h010 = mix_hash(X0 ^ Y1 ^ Z0), h110 = mix_hash(X1 ^ Y1 ^ Z0),
+                 h001 = mix_hash(X0 ^ Y0 ^ Z1), h101 = mix_hash(X1 ^ Y0 ^ Z1),
+                 h011 = mix_hash(X0 ^ Y1 ^ Z1), h111 = mix_hash(X1 ^ Y1 ^ Z1);
+        float x = X.offset[j], y = Y.offset[j], z = Z.offset[j];
+        float x1 = x - 1, y1 = y - 1, z1 = z - 1;
+        float n000 = grad3(h000, x,  y,  z),  n100 = grad3(h100, x1, y,  z),
+              n010 = grad3(h010, x,  y1, z),  n110 = grad3(h110, x1, y1, z),
+              n001 = grad3(h001, x,  y,  z1), n101 = grad3(h101, x1, y,  z1),
+              n011 = grad3(h011, x,  y1, z1), n111 = grad3(h111, x1, y1, z1);
+        float c[8][3];
+        grad3_vector(h000, c[0][0], c[0][1], c[0][2]);
+        grad3_vector(h100, c[1][0], c[1][1], c[1][2]);
+        grad3_vector(h010, c[2][0], c[2][1], c[2][2]);
+        grad3_vector(h110, c[3][0], c[3][1], c[3][2]);
+        grad3_vector(h001, c[4][0], c[4][1], c[4][2]);
+        grad3_vector(h101, c[5][0], c[5][1], c[5][2]);
+        grad3_vector(h011, c[6][0], c[6][1], c[6][2]);
+        grad3_vector(h111, c[7][0], c[7][1], c[7][2]);
+        float u = X.fade[j], v = Y.fade[j], w = Z.fade[j];
+        float near = bilerp(n000, n100, n010, n110, u, v),
+              far = bilerp(n001, n101, n011, n111, u, v);
+        out[j] = perlin3_scale * lerp(near, far, w);
+        float slope[3] = {
+            fade_slope(x) * lerp(lerp(n100 - n000, n110 - n010, v),
+                                 lerp(n101 - n001, n111 - n011, v), w),
+            fade_slope(y) * lerp(lerp(n010, n110, u) - lerp(n000, n100, u),
+                                 lerp(n011, n111, u) - lerp(n001, n101, u),
+                                 w),
+            fade_slope(z) * (far - near)
+        };
+        for (int d = 0; d < 3; d++)
+            g[d][j] = perlin3_scale * (slope[d] + lerp(
+                bilerp(c[0][d], c[1][d], c[2][d], c[3][d], u, v),
+                bilerp(c[4][d], c[5][d], c[6][d], c[7][d], u, v), w));
+    }
+}
+
+// A simplex corner at offset (x, y, z) adds falloff(t) * dot(c, offset), with
+// t = .5 - |offset|^2 and c its gradient vector. Its gradient is
+// falloff(t) * c - 8 t^3 * dot(c, offset) * offset where t > 0.
+inline float
+simplex_slope(float t) {
+    t = blend(mask(t > 0), t, 0.f);
+    return -8 * t * t * t;
+}
+
+template<int N>
+void
+simplex2_gradient(const Lattice& l, uint32_t seed, float* out,
+                  float (*g)[lanes]) {
+    const float s = .21132486540518712f;
+    for (int j = 0; j < N; j++) {
+        uint32_t X = l.cell[0][j], Y = l.cell[1][j];
+        float x0 = l.offset[0][j], y0 = l.offset[1][j];
+        int32_t i1 = x0 > y0, j1 = 1 - i1;
+        float x[3] = { x0, x0 - i1 + s, x0 - 1 + 2 * s },
+              y[3] = { y0, y0 - j1 + s, y0 - 1 + 2 * s };
+        uint32_t h[3] = { lattice_hash(X, Y, 0, seed),
+                          lattice_hash(X + i1, Y + j1, 0, seed),
+                          lattice_hash(X + 1, Y + 1, 0, seed) };
+        float n = 0, gx = 0, gy = 0;
+        for (int c = 0; c < 3; c++) {
+            float t = .5f - x[c]*x[c] - y[c]*y[c],
+                  f = falloff(t), dot = grad2(h[c], x[c], y[c]), cx, cy;
+            grad2_vector(h[c], cx, cy);
+            float k = simplex_slope(t) * dot;
+            n += f * dot;
+            gx += f * cx + k * x[c];
+            gy += f * cy + k * y[c];
+        }
+        out[j] = simplex2_scale * n;
+        g[0][j] = simplex2_scale * gx;
+        g[1][j] = simplex2_scale * gy;
+    }
+}
+
+template<int N>
+void
+simplex3_gradient(const Lattice& l, uint32_t seed, float* out,
+                  float (*g)[lanes]) {
+    const float s = 1/6.f;
+    for (int j = 0; j < N; j++) {
+        uint32_t X = l.cell[0][j], Y = l.cell[1][j], Z = l.cell[2][j];
+        float x0 = l.offset[0][j], y0 = l.offset[1][j], z0 = l.offset[2][j];
+        int32_t xy = x0 >= y0, yz = y0 >= z0, xz = x0 >= z0;
+        int32_t i1 = xy & xz, j1 = (1 - xy) & yz, k1 = (1 - xz) & (1 - yz),
+                i2 = xy | xz, j2 = (1 - xy) | yz, k2 = 1 - (xz & yz);
+        float x[4] = { x0, x0 - i1 + s, x0 - i2 + 2 * s, x0 - 1 + 3 * s },
+              y[4] = { y0, y0 - j1 + s, y0 - j2 + 2 * s, y0 - 1 + 3 * s },
+              z[4] = { z0, z0 - k1 + s, z0 - k2 + 2 * s, z0 - 1 + 3 * s };
+        uint32_t h[4] = { lattice_hash(X, Y, Z, seed),
+                          lattice_hash(X + i1, Y + j1, Z + k1, seed),
+                          lattice_hash(X + i2, Y + j2, Z + k2, seed),
+                          lattice_hash(X + 1, Y + 1, Z + 1, seed) };
+        float n = 0, gx = 0, gy = 0, gz = 0;
+        for (int c = 0; c < 4; c++) {
+            float t = .5f - x[c]*x[c] - y[c]*y[c] - z[c]*z[c],
+                  f = falloff(t), dot = grad3(h[c], x[c], y[c], z[c]),
+                  cx, cy, cz;
+            grad3_vector(h[c], cx, cy, cz);
+            float k = simplex_slope(t) * dot;
+            n += f * dot;
+            gx += f * cx + k * x[c];
+            gy += f * cy + k * y[c];
+            gz += f * cz + k * z[c];
+        }
+        out[j] = simplex3_scale * n;
+        g[0][j] = simplex3_scale * gx;
+        g[1][j] = simplex3_scale * gy;
+        g[2][j] = simplex3_scale * gz;
+    }
+}
+
+// one octave of the basis at the first N points
+template<int D, int N>
+void
+basis_octave(GradientNoise::Basis basis, const double (&p)[D][lanes],
+             double frequency, uint32_t seed, float* out) {
+    if (basis == GradientNoise::Basis::perlin) {
+        PerlinLattice l;
+        perlin_lattice<D, N>(p, frequency, l);
+        D == 2 ? perlin2<N>(l, seed, out) : perlin3<N>(l, seed, out);
+    } else {
+        Lattice l;
+        simplex_lattice<D, N>(p, frequency, l);
+        D == 2 ? simplex2<N>(l, seed, out) : simplex3<N>(l, seed, out);
+    }
+}
+
+template<int D, int N>
+void
+basis_octave_gradient(GradientNoise::Basis basis,
+                      const double (&p)[D][lanes], double frequency,
+                      uint32_t seed, float* out, float (*g)[lanes]) {
+    if (basis == GradientNoise::Basis::perlin) {
+        PerlinLattice l;
+        perlin_lattice<D, N>(p, frequency, l);
+        D == 2 ? perlin2_gradient<N>(l, seed, out, g)
+               : perlin3_gradient<N>(l, seed, out, g);
+    } else {
+        Lattice l;
+        simplex_lattice<D, N>(p, frequency, l);
+        D == 2 ? simplex2_gradient<N>(l, seed, out, g)
+               : simplex3_gradient<N>(l, seed, out, g);
+    }
+}
+
+}
+
+GradientNoise::GradientNoise(Basis basis, Fractal fractal) :
+    basis(basis), fractal(fractal)
+{}
+
+void
+GradientNoise::set_octaves(int v)
+{
+    if (v < 1 || v > max_octaves)
+        throw domain_error("GradientNoise: octaves must be in [1, 30]");
+    octaves = v;
+}
+
+void
+GradientNoise::reseed()
+{
+    reseed(gen);
+}
+
+void
+GradientNoise::reseed(entropy::Generator& g)
+{
+    seed = g() >> 32;
+}
+
+// The octaves are summed as by libnoise's Perlin and RidgedMulti modules.
+template<int N, typename Octave>
+void
+GradientNoise::accumulate(const Octave& octave, double* out) const
+{
+    float n[lanes], value[lanes] = {}, weight[lanes];
+    std::fill(weight, weight + lanes, 1.f);
+    double f = frequency;
+    float amplitude = 1;
+    for (int o = 0; o < octaves; o++) {
+        octave(o, f, n);
+        if (fractal == Fractal::sum)
+            for (int j = 0; j < N; j++)
+                value[j] += n[j] * amplitude;
+        else
+            // ridges at the zeros, weighted by the octave before, with
+            // offset 1, gain 2 and exponent 1
+            for (int j = 0; j < N; j++) {
+                float signal = 1 - std::fabs(n[j]);
+                signal *= signal * weight[j];
+                weight[j] = std::min(1.f, std::max(0.f, signal * 2));
+                value[j] += signal * amplitude;
+            }
+        f *= lacunarity;
+        amplitude *= fractal == Fractal::sum ? persistence : 1 / lacunarity;
+    }
+    for (int j = 0; j < N; j++)
+        out[j] = fractal == Fractal::sum ? value[j] : value[j] * 1.25 - 1;
+}
+
+template<int D, int N>
+void
+GradientNoise::evaluate(const double (&p)[D][lanes], double* out) const
+{
+    accumulate<N>([&](int o, double f, float* n) {
+        basis_octave<D, N>(basis, p, f, seed + o, n);
+    }, out);
+}
+
+// As accumulate(), with the chain rule through the frequency of each octave
+// and, for ridges, through the absolute value, the square and the weight.
+template<int D, int N, typename Octave>
+void
+GradientNoise::accumulate_gradient(const Octave& octave, double* out,
+                                   double (*grad)[lanes]) const
+{
+    float n[lanes], g[3][lanes], value[lanes] = {}, weight[lanes];
+    float dvalue[D][lanes] = {}, dweight[D][lanes] = {};
+    std::fill(weight, weight + lanes, 1.f);
+    double f = frequency;
+    float amplitude = 1;
+    for (int o = 0; o < octaves; o++) {
+        octave(o, f, n, g);
+        float slope = amplitude * f;
+        if (fractal == Fractal::sum)
+            for (int j = 0; j < N; j++) {
+                value[j] += n[j] * amplitude;
+                for (int d = 0; d < D; d++)
+                    dvalue[d][j] += g[d][j] * slope;
+            }
+        else
+            for (int j = 0; j < N; j++) {
+                // as in accumulate(), to give the same values
+                float a = 1 - std::fabs(n[j]), signal = a * (a * weight[j]);
+                // d(a^2) = -2 a sign(n) dn
+                float da = flip(-2 * a * weight[j] * f, n[j] < 0);
+                uint32_t clamped = mask(signal * 2 >= 1);
+                for (int d = 0; d < D; d++) {
+                    float ds = da * g[d][j] + a * a * dweight[d][j];
+                    dweight[d][j] = blend(clamped, 0.f, 2 * ds);
+                    dvalue[d][j] += ds * amplitude;
+                }
+                weight[j] = std::min(1.f, std::max(0.f, signal * 2));
+                value[j] += signal * amplitude;
+            }
+        f *= lacunarity;
+        amplitude *= fractal == Fractal::sum ? persistence : 1 / lacunarity;
+    }
+    double scale = fractal == Fractal::sum ? 1 : 1.25;
+    for (int j = 0; j < N; j++) {
+        out[j] = fractal == Fractal::sum ? value[j] : value[j] * 1.25 - 1;
+        for (int d = 0; d < D; d++)
+            grad[d][j] = dvalue[d][j] * scale;
+    }
+}
+
+template<int D, int N>
+void
+GradientNoise::evaluate_gradient(const double (&p)[D][lanes], double* out,
+                                 double (*grad)[lanes]) const
+{
+    accumulate_gradient<D, N>([&](int o, double f, float* n,
+                                  float (*g)[lanes]) {
+        basis_octave_gradient<D, N>(basis, p, f, seed + o, n, g);
+    }, out, grad);
+}
+
+double
+GradientNoise::operator()(dvec2 v) const
+{
+    double p[2][lanes] = { { v.x }, { v.y } }, out;
+    evaluate<2, 1>(p, &out);
+    return out;
+}
+
+double
+GradientNoise::operator()(dvec3 v) const
+{
+    double p[3][lanes] = { { v.x }, { v.y }, { v.z } }, out;
+    evaluate<3, 1>(p, &out);
+    return out;
+}
+
+NoiseGradient<dvec2>
+GradientNoise::gradient(dvec2 v) const
+{
+    double p[2][lanes] = { { v.x }, { v.y } }, out, g[2][lanes];
+    evaluate_gradient<2, 1>(p, &out, g);
+    return { out, { g[0][0], g[1][0] } };
+}
+
+NoiseGradient<dvec3>
+GradientNoise::gradient(dvec3 v) const
+{
+    double p[3][lanes] = { { v.x }, { v.y }, { v.z } }, out, g[3][lanes];
+    evaluate_gradient<3, 1>(p, &out, g);
+    return { out, { g[0][0], g[1][0], g[2][0] } };
+}
+
+// lane j of gradients stored coordinate by coordinate
+static void
+lane_gradient(const double (*g)[lanes], int j, dvec2& v) {
+    v = { g[0][j], g[1][j] };
+}
+
+static void
+lane_gradient(const double (*g)[lanes], int j, dvec3& v) {
+    v = { g[0][j], g[1][j], g[2][j] };
+}
+
+// Points go in blocks of lanes, the last one padded, and evaluate(p, i, n)
+// stores the results of the n points from i. what names the class in the
+// error.
+template<int D, typename Vec, typename Out, typename Evaluate>
+static void
+evaluate_blocks(span<const Vec> points, span<Out> out, const char* what,
+                const Evaluate& evaluate) {
+    if (points.size() != out.size())
+        throw std::invalid_argument(std::string(what) + ": sizes differ");
+    double p[D][lanes] = {};
+    for (size_t i = 0; i < points.size(); i += lanes) {
+        size_t n = std::min(points.size() - i, (size_t)lanes);
+        for (size_t j = 0; j < n; j++)
+            for (int d = 0; d < D; d++)
+                p[d][j] = points[i + j][d];
+        evaluate(p, i, n);
+    }
+}
+
+template<int D, typename Vec>
+void
+GradientNoise::evaluate_points(span<const Vec> points, span<double> out) const
+{
+    evaluate_blocks<D>(points, out, "GradientNoise",
+                       [&](const double (&p)[D][lanes], size_t i, size_t n) {
+        double block[lanes];
+        evaluate<D, lanes>(p, block);
+        std::copy(block, block + n, &out[i]);
+    });
+}
+
+template<int D, typename Vec>
+void
+GradientNoise::evaluate_points(span<const Vec> points,
+                               span<NoiseGradient<Vec>> out) const
+{
+    evaluate_blocks<D>(points, out, "GradientNoise",
+                       [&](const double (&p)[D][lanes], size_t i, size_t n) {
+        double block[lanes], g[D][lanes];
+        evaluate_gradient<D, lanes>(p, block, g);
+        for (size_t j = 0; j < n; j++) {
+            out[i + j].value = block[j];
+            lane_gradient(g, j, out[i + j].gradient);
+        }
+    });
+}
+
+void
+GradientNoise::operator()(span<const dvec2> points, span<double> out) const
+{
+    evaluate_points<2>(points, out);
+}
+
+void
+GradientNoise::operator()(span<const dvec3> points, span<double> out) const
+{
+    evaluate_points<3>(points, out);
+}
+
+void
+GradientNoise::gradient(span<const dvec2> points,
+                        span<NoiseGradient<dvec2>> out) const
+{
+    evaluate_points<2>(points, out);
+}
+
+void
+GradientNoise::gradient(span<const dvec3> points,
+                        span<NoiseGradient<dvec3>> out) const
+{
+    evaluate_points<3>(points, out);
+}
+
+// The lattice of Perlin noise separates into axes, and on grids whose rows
+// and columns run along axes each of them is computed once per column, once
+// per row or once for the image, at each octave. Only hashing and gradients
+// are left for each point.
+template<int D, typename Vec>
+void
+GradientNoise::fill_axes(Image<double>& image, Image<Vec>* gradient,
+                         Vec origin, int a, double da, int b, double db,
+                         Parallel parallel) const
+{
+    int blocks = (image.size().x + lanes-1) / lanes;
+    std::vector<PerlinAxis> columns(octaves * blocks);
+    double f = frequency;
+    for (int o = 0; o < octaves; o++, f *= lacunarity)
+        for (int k = 0; k < blocks; k++)
+            for (int j = 0; j < lanes; j++)
+                perlin_axis(columns[o * blocks + k], a, j,
+                            (origin[a] + (k * lanes + j) * da) * f);
+
+    fill_rows(image, parallel, [&](int y, span<double> row) {
+        // the row and the constant axes in all lanes
+        PerlinLattice lattice[max_octaves];
+        double f = frequency;
+        for (int o = 0; o < octaves; o++, f *= lacunarity)
+            for (int d = 0; d < D; d++)
+                if (d != a)
+                    for (int j = 0; j < lanes; j++)
+                        perlin_axis(lattice[o].axis[d], d, j,
+                                    (origin[d] + (d == b ? y * db : 0)) * f);
+        auto octave_lattice = [&](int o, int k) -> const PerlinLattice& {
+            lattice[o].axis[a] = columns[o * blocks + k];
+            return lattice[o];
+        };
+
+        double block[lanes], g[D][lanes];
+        for (int k = 0; k < blocks; k++) {
+            int x = k * lanes, n = std::min(lanes, (int)row.size() - x);
+            if (!gradient)
+                accumulate<lanes>([&](int o, double, float* out) {
+                    auto& l = octave_lattice(o, k);
+                    D == 2 ? perlin2<lanes>(l, seed + o, out)
+                           : perlin3<lanes>(l, seed + o, out);
+                }, block);
+            else {
+                accumulate_gradient<D, lanes>([&](int o, double, float* out,
+                                                  float (*g)[lanes]) {
+                    auto& l = octave_lattice(o, k);
+                    D == 2 ? perlin2_gradient<lanes>(l, seed + o, out, g)
+                           : perlin3_gradient<lanes>(l, seed + o, out, g);
+                }, block, g);
+                auto grad_row = gradient->row(y);
+                for (int j = 0; j < n; j++)
+                    lane_gradient(g, j, grad_row[x + j]);
+            }
+            std::copy(block, block + n, &row[x]);
+        }
+    });
+}
+
+// Pixel (x, y) is at origin + x * dx + y * dy. Without a gradient image only
+// values are computed.
+template<int D, typename Vec>
+void
+GradientNoise::fill_grid(Image<double>& image, Image<Vec>* gradient,
+                         Vec origin, Vec dx, Vec dy, Parallel parallel) const
+{
+    if (gradient && gradient->size() != image.size())
+        throw std::invalid_argument("GradientNoise: image sizes differ");
+    int a = only_axis<D>(dx), b = only_axis<D>(dy);
+    if (basis == Basis::perlin && a >= 0 && b >= 0 && a != b) {
+        fill_axes<D>(image, gradient, origin, a, dx[a], b, dy[b], parallel);
+        return;
+    }
+    fill_rows(image, parallel, [&](int y, span<double> row) {
+        std::vector<Vec> points(row.size());
+        for (size_t x = 0; x < row.size(); x++)
+            points[x] = grid_point(origin, dx, dy, x, y);
+        if (!gradient) {
+            evaluate_points<D>(span<const Vec>(points), row);
+            return;
+        }
+        std::vector<NoiseGradient<Vec>> out(row.size());
+        evaluate_points<D>(span<const Vec>(points),
+                           span<NoiseGradient<Vec>>(out));
+        auto grad_row = gradient->row(y);
+        for (size_t x = 0; x < row.size(); x++) {
+            row[x] = out[x].value;
+            grad_row[x] = out[x].gradient;
+        }
+    });
+}
+
+void
+GradientNoise::fill(Image<double>& image, dvec2 origin, dvec2 step,
+                    Parallel parallel) const
+{
+    fill_grid<2>(image, (Image<dvec2>*)nullptr, origin,
+                 dvec2(step.x, 0), dvec2(0, step.y), parallel);
+}
+
+void
+GradientNoise::fill(Image<double>& image, dvec3 origin, dvec3 dx, dvec3 dy,
+                    Parallel parallel) const
+{
+    fill_grid<3>(image, (Image<dvec3>*)nullptr, origin, dx, dy, parallel);
+}
+
+void
+GradientNoise::fill(Image<double>& image, Image<dvec2>& gradient,
+                    dvec2 origin, dvec2 step, Parallel parallel) const
+{
+    fill_grid<2>(image, &gradient, origin,
+                 dvec2(step.x, 0), dvec2(0, step.y), parallel);
+}
+
+void
+GradientNoise::fill(Image<double>& image, Image<dvec3>& gradient,
+                    dvec3 origin, dvec3 dx, dvec3 dy, Parallel parallel) const
+{
+    fill_grid<3>(image, &gradient, origin, dx, dy, parallel);
+}
+
+bool
+GradientNoise::operator==(const GradientNoise& _) const
+{
+    return basis == _.basis && fractal == _.fractal &&
+           frequency == _.frequency && lacunarity == _.lacunarity &&
+           persistence == _.persistence && octaves == _.octaves &&
+           seed == _.seed;
+}
+
+
+//
+// CellularNoise
+//
+
+namespace {
+
+// Feature points lie in [.5 - s/2, .5 + s/2] of their cells along each
+// axis. Taking a point's own cell and the neighbor across its nearest face,
+// the second nearest feature is at most sqrt((c+.5)^2 + (D-1)(c-.5)^2) away
+// with c = (1+s)/2, and features outside the 3^D cells around the point are
+// more than (3-s)/2 away, so that search finds F1 and F2 for s up to .455.
+const float cellular_spread = .45f;
+
+// For any s, the same two cells put the second nearest feature at most
+// sqrt(2.5) away in 2D and sqrt(3) in 3D, nearer than any cell three steps
+// away. No corner of the 5^D cells around the point is nearer than that
+// bound either, so a wider search of that block without its corners finds
+// F1 and F2 at any jitter. Its outer cells are
+// only visited if they may be nearer than F2 for some lane; the bounds are
+// lowered a little so that rounding never skips a feature, and a batch gives
+// the same results as single points.
+const float cellular_slack = 1e-4f;
+
+// decorrelate the coordinates of a feature point drawn from one cell hash
+const uint32_t feature_salt[3] = { 0x68e31da4u, 0xb5297a4du, 0x1b56c4e9u };
+
+// Cells are hashed as lattice points of GradientNoise are, from a term per
+// axis. Squared distances are kept in float, in units of cells, with F1, F2
+// and the cell of F1 updated by blends as each neighbor is visited.
+template<int D, int N>
+void
+cellular(const double (&p)[D][lanes], double frequency, float spread,
+         uint32_t seed, CellularSample* out) {
+    uint32_t term[D][5][lanes];
+    float offset[D][lanes];
+    for (int d = 0; d < D; d++)
+        for (int j = 0; j < N; j++) {
+            double x = wrap(p[d][j] * frequency), f = round_down(x);
+            uint32_t cell = (int32_t)f;
+            offset[d][j] = x - f;
+            for (int k = 0; k < 5; k++)
+                term[d][k][j] = (cell + k - 2) * hash_multiplier[d];
+        }
+
+    float f1[lanes], f2[lanes];
+    uint32_t id[lanes];
+    std::fill_n(f1, lanes, 1e30f);
+    std::fill_n(f2, lanes, 1e30f);
+    std::fill_n(id, lanes, 0);
+    // the neighbor along each axis, 0 to 4 for steps of -2 to 2
+    auto visit = [&](const int (&step)[3]) {
+        for (int j = 0; j < N; j++) {
+            uint32_t h = seed;
+            for (int d = 0; d < D; d++)
+                h ^= term[d][step[d]][j];
+            h = mix_hash(h);
+            float dist = 0;
+            for (int d = 0; d < D; d++) {
+                float r = (mix_hash(h ^ feature_salt[d]) >> 8) *
+                          (1.f / 16777216);
+                float v = (step[d] - 1.5f) + spread * (r - .5f) - offset[d][j];
+                dist += v * v;
+            }
+            uint32_t nearest = mask(dist < f1[j]);
+            f2[j] = blend(nearest, f1[j],
+                          blend(mask(dist < f2[j]), dist, f2[j]));
+            f1[j] = blend(nearest, dist, f1[j]);
+            id[j] = blend(nearest, h, id[j]);
+        }
+    };
+
+    for (int k = 0; k < (D == 2 ? 9 : 27); k++) {
+        int step[3] = { k % 3 + 1, k / 3 % 3 + 1, k / 9 + 1 };
+        visit(step);
+    }
+    if (spread > cellular_spread)
+        for (int k = 0; k < (D == 2 ? 25 : 125); k++) {
+            int step[3] = { k % 5, k / 5 % 5, k / 25 }, outer = 0;
+            for (int d = 0; d < D; d++)
+                outer += step[d] == 0 || step[d] == 4;
+            if (outer == 0 || outer == D)
+                continue;
+            uint32_t near = 0;
+            for (int j = 0; j < N; j++) {
+                float bound = 0;
+                for (int d = 0; d < D; d++) {
+                    float gap = std::max(std::abs(step[d] - 1.5f -
+                                                  offset[d][j]) -
+                                         .5f * spread - cellular_slack, 0.f);
+                    bound += gap * gap;
+                }
+                near |= mask(bound < f2[j]);
+            }
+            if (near)
+                visit(step);
+        }
+
+    for (int j = 0; j < N; j++)
+        out[j] = { std::sqrt(f1[j]) / frequency, std::sqrt(f2[j]) / frequency,
+                   id[j] };
+}
+
+}
+
+void
+CellularNoise::set_jitter(double v)
+{
+    if (!(v >= 0 && v <= 1))
+        throw domain_error("CellularNoise: jitter must be in [0, 1]");
+    jitter = v;
+}
+
+void
+CellularNoise::reseed()
+{
+    reseed(gen);
+}
+
+void
+CellularNoise::reseed(entropy::Generator& g)
+{
+    seed = g() >> 32;
+}
+
+template<int D, int N>
+void
+CellularNoise::evaluate(const double (&p)[D][lanes],
+                        CellularSample* out) const
+{
+    cellular<D, N>(p, frequency, jitter, seed, out);
+}
+
+CellularSample
+CellularNoise::operator()(dvec2 v) const
+{
+    double p[2][lanes] = { { v.x }, { v.y } };
+    CellularSample out;
+    evaluate<2, 1>(p, &out);
+    return out;
+}
+
+CellularSample
+CellularNoise::operator()(dvec3 v) const
+{
+    double p[3][lanes] = { { v.x }, { v.y }, { v.z } };
+    CellularSample out;
+    evaluate<3, 1>(p, &out);
+    return out;
+}
+
+template<int D, typename Vec>
+void
+CellularNoise::evaluate_points(span<const Vec> points,
+                               span<CellularSample> out) const
+{
+    evaluate_blocks<D>(points, out, "CellularNoise",
+                       [&](const double (&p)[D][lanes], size_t i, size_t n) {
+        CellularSample block[lanes];
+        evaluate<D, lanes>(p, block);
+        std::copy(block, block + n, &out[i]);
+    });
+}
+
+void
+CellularNoise::operator()(span<const dvec2> points,
+                          span<CellularSample> out) const
+{
+    evaluate_points<2>(points, out);
+}
+
+void
+CellularNoise::operator()(span<const dvec3> points,
+                          span<CellularSample> out) const
+{
+    evaluate_points<3>(points, out);
+}
+
+void
+CellularNoise::fill(Image<CellularSample>& image, dvec2 origin, dvec2 step,
+                    Parallel parallel) const
+{
+    fill_rows(image, parallel, [&](int y, span<CellularSample> row) {
+        std::vector<dvec2> points(row.size());
+        for (size_t x = 0; x < row.size(); x++)
+            points[x] = grid_point(origin, step, x, y);
+        evaluate_points<2>(span<const dvec2>(points), row);
+    });
+}
+
+void
+CellularNoise::fill(Image<CellularSample>& image, dvec3 origin, dvec3 dx,
+                    dvec3 dy, Parallel parallel) const
+{
+    fill_rows(image, parallel, [&](int y, span<CellularSample> row) {
+        std::vector<dvec3> points(row.size());
+        for (size_t x = 0; x < row.size(); x++)
+            points[x] = grid_point(origin, dx, dy, x, y);
+        evaluate_points<3>(span<const dvec3>(points), row);
+    });
+}
+
+
+//
+// NoiseGraph
+//
+
+namespace {
+
+enum class NodeOp {
+    constant, coordinate, noise,
+    add, subtract, multiply, affine, abs, min, max, clamp, blend
+};
+
+// Operands in arg are node ids in the graph and registers in a kernel, -1
+// if unused. Noise nodes take the offsets of x, y and z there.
+struct GraphNode {
+    NodeOp op;
+    int arg[3] = { -1, -1, -1 };
+    // constant: value; affine: scale, bias; clamp: lo, hi
+    double u = 0, v = 0;
+    // coordinate: axis; noise: index of the module
+    int source = -1;
+
+    explicit GraphNode(NodeOp op) : op(op) {}
+
+    // compared by the bits of u and v, so that nan constants are shared too
+    typedef std::tuple<int, int, int, int, uint64_t, uint64_t, int> Key;
+    Key key() const {
+        return Key((int)op, arg[0], arg[1], arg[2],
+                   bits_of(u), bits_of(v), source);
+    }
+};
+
+// points evaluated together by kernels; the registers of a block of them
+// stay in L1 cache for graphs of a few dozen nodes
+const int graph_block = 64;
+
+}
+
+struct NoiseGraph::impl {
+    std::vector<GraphNode> nodes;
+    std::vector<GradientNoise> sources;
+    std::map<GraphNode::Key, int> index;
+
+    static impl* of(Node a) { return a.graph; }
+    static impl* of(Node a, Node b) {
+        if (a.graph != b.graph)
+            throw std::invalid_argument("NoiseGraph: nodes of different graphs");
+        return a.graph;
+    }
+
+    void check(Node a) const {
+        if (a.graph != this)
+            throw std::invalid_argument("NoiseGraph: node of another graph");
+    }
+
+    Node make(const GraphNode& n) {
+        auto i = index.emplace(n.key(), (int)nodes.size());
+        if (i.second)
+            nodes.push_back(n);
+        return { this, i.first->second };
+    }
+
+    GraphNode noise(const GradientNoise& source) {
+        GraphNode n(NodeOp::noise);
+        auto i = std::find(sources.begin(), sources.end(), source);
+        n.source = i - sources.begin();
+        if (i == sources.end())
+            sources.push_back(source);
+        return n;
+    }
+
+    bool is_constant(Node a, double& v) const {
+        auto& n = nodes[a.id];
+        v = n.u;
+        return n.op == NodeOp::constant;
+    }
+
+    Node constant(double v) {
+        GraphNode n(NodeOp::constant);
+        n.u = v;
+        return make(n);
+    }
+
+    Node affine(Node a, double scale, double bias) {
+        GraphNode n = nodes[a.id];
+        if (n.op == NodeOp::constant)
+            return constant(n.u * scale + bias);
+        if (n.op == NodeOp::affine)
+            return affine({ this, n.arg[0] }, n.u * scale, n.v * scale + bias);
+        if (scale == 1 && bias == 0)
+            return a;
+        GraphNode r(NodeOp::affine);
+        r.arg[0] = a.id;
+        r.u = scale;
+        r.v = bias;
+        return make(r);
+    }
+
+    Node unary(NodeOp op, Node a, double u = 0, double v = 0) {
+        GraphNode r(op);
+        r.arg[0] = a.id;
+        r.u = u;
+        r.v = v;
+        return make(r);
+    }
+
+    // commutative operations take their operands in order, so that a + b
+    // and b + a are shared
+    Node binary(NodeOp op, Node a, Node b, bool commutative) {
+        if (commutative && b.id < a.id)
+            std::swap(a, b);
+        GraphNode r(op);
+        r.arg[0] = a.id;
+        r.arg[1] = b.id;
+        return make(r);
+    }
+};
+
+NoiseGraph::NoiseGraph() : p(new impl) {}
+NoiseGraph::~NoiseGraph() = default;
+
+NoiseGraph::Node
+NoiseGraph::constant(double v)
+{
+    return p->constant(v);
+}
+
+NoiseGraph::Node
+NoiseGraph::coordinate(int axis)
+{
+    if (axis < 0 || axis > 2)
+        throw domain_error("NoiseGraph: axis must be 0, 1 or 2");
+    GraphNode n(NodeOp::coordinate);
+    n.source = axis;
+    return p->make(n);
+}
+
+NoiseGraph::Node
+NoiseGraph::noise(const GradientNoise& source)
+{
+    return p->make(p->noise(source));
+}
+
+NoiseGraph::Node
+NoiseGraph::noise(const GradientNoise& source, Node dx, Node dy)
+{
+    p->check(dx);
+    p->check(dy);
+    GraphNode n = p->noise(source);
+    n.arg[0] = dx.id;
+    n.arg[1] = dy.id;
+    return p->make(n);
+}
+
+NoiseGraph::Node
+NoiseGraph::noise(const GradientNoise& source, Node dx, Node dy, Node dz)
+{
+    p->check(dx);
+    p->check(dy);
+    p->check(dz);
+    GraphNode n = p->noise(source);
+    n.arg[0] = dx.id;
+    n.arg[1] = dy.id;
+    n.arg[2] = dz.id;
+    return p->make(n);
+}
+
+int
+NoiseGraph::size() const
+{
+    return p->nodes.size();
+}
+
+NoiseGraph::Node
+NoiseGraph::Node::add(Node a, Node b)
+{
+    auto g = impl::of(a, b);
+    double u, v;
+    bool ca = g->is_constant(a, u), cb = g->is_constant(b, v);
+    if (ca && cb)
+        return g->constant(u + v);
+    if (ca)
+        return g->affine(b, 1, u);
+    if (cb)
+        return g->affine(a, 1, v);
+    if (a.id == b.id)
+        return g->affine(a, 2, 0);
+    return g->binary(NodeOp::add, a, b, true);
+}
+
+NoiseGraph::Node
+NoiseGraph::Node::subtract(Node a, Node b)
+{
+    auto g = impl::of(a, b);
+    double u, v;
+    bool ca = g->is_constant(a, u), cb = g->is_constant(b, v);
+    if (ca && cb)
+        return g->constant(u - v);
+    if (ca)
+        return g->affine(b, -1, u);
+    if (cb)
+        return g->affine(a, 1, -v);
+    return g->binary(NodeOp::subtract, a, b, false);
+}
+
+NoiseGraph::Node
+NoiseGraph::Node::multiply(Node a, Node b)
+{
+    auto g = impl::of(a, b);
+    double u, v;
+    bool ca = g->is_constant(a, u), cb = g->is_constant(b, v);
+    if (ca && cb)
+        return g->constant(u * v);
+    if (ca)
+        return g->affine(b, u, 0);
+    if (cb)
+        return g->affine(a, v, 0);
+    return g->binary(NodeOp::multiply, a, b, true);
+}
+
+NoiseGraph::Node
+NoiseGraph::Node::affine(Node a, double scale, double bias)
+{
+    return impl::of(a)->affine(a, scale, bias);
+}
+
+NoiseGraph::Node
+NoiseGraph::Node::absolute(Node a)
+{
+    auto g = impl::of(a);
+    double u;
+    if (g->is_constant(a, u))
+        return g->constant(std::fabs(u));
+    if (g->nodes[a.id].op == NodeOp::abs)
+        return a;
+    return g->unary(NodeOp::abs, a);
+}
+
+NoiseGraph::Node
+NoiseGraph::Node::minimum(Node a, Node b)
+{
+    auto g = impl::of(a, b);
+    double u, v;
+    if (g->is_constant(a, u) && g->is_constant(b, v))
+        return g->constant(std::min(u, v));
+    if (a.id == b.id)
+        return a;
+    return g->binary(NodeOp::min, a, b, true);
+}
+
+NoiseGraph::Node
+NoiseGraph::Node::maximum(Node a, Node b)
+{
+    auto g = impl::of(a, b);
+    double u, v;
+    if (g->is_constant(a, u) && g->is_constant(b, v))
+        return g->constant(std::max(u, v));
+    if (a.id == b.id)
+        return a;
+    return g->binary(NodeOp::max, a, b, true);
+}
+
+NoiseGraph::Node
+NoiseGraph::Node::clamped(Node a, double lo, double hi)
+{
+    if (!(lo <= hi))
+        throw domain_error("NoiseGraph: clamp needs lo <= hi");
+    auto g = impl::of(a);
+    double u;
+    if (g->is_constant(a, u))
+        return g->constant(std::min(std::max(u, lo), hi));
+    return g->unary(NodeOp::clamp, a, lo, hi);
+}
+
+NoiseGraph::Node
+NoiseGraph::Node::blended(Node a, Node b, Node t)
+{
+    auto g = impl::of(a, b);
+    impl::of(a, t);
+    double u;
+    if (a.id == b.id)
+        return a;
+    if (g->is_constant(t, u)) {
+        if (u == 0)
+            return a;
+        if (u == 1)
+            return b;
+        return a + (b - a) * u;
+    }
+    GraphNode r(NodeOp::blend);
+    r.arg[0] = a.id;
+    r.arg[1] = b.id;
+    r.arg[2] = t.id;
+    return g->make(r);
+}
+
+
+//
+// NoiseKernel
+//
+
+// The nodes of a graph in evaluation order, with operands renumbered to
+// registers, which are the positions in code.
+struct NoiseKernel::program {
+    std::vector<GraphNode> code;
+    std::vector<std::string> names;
+    std::vector<GradientNoise> sources;
+    int output;
+
+    // adds the time spent in each node to ns if not null
+    template<int D, typename Vec>
+    void run(span<const Vec> points, span<double> out,
+             std::vector<double>* ns) const;
+    template<int D, typename Vec>
+    std::vector<NodeCost> profile(span<const Vec> points) const;
+};
+
+static std::string
+node_name(const GraphNode& n, const std::string& source)
+{
+    std::ostringstream s;
+    switch (n.op) {
+    case NodeOp::constant:   s << "constant " << n.u; break;
+    case NodeOp::coordinate: s << "xyz"[n.source]; break;
+    case NodeOp::noise:
+        s << "noise " << source;
+        if (n.arg[0] >= 0)
+            s << ", warped";
+        break;
+    case NodeOp::add:        s << "add"; break;
+    case NodeOp::subtract:   s << "subtract"; break;
+    case NodeOp::multiply:   s << "multiply"; break;
+    case NodeOp::affine:     s << "scale " << n.u << ", bias " << n.v; break;
+    case NodeOp::abs:        s << "abs"; break;
+    case NodeOp::min:        s << "min"; break;
+    case NodeOp::max:        s << "max"; break;
+    case NodeOp::clamp:      s << "clamp " << n.u << ", " << n.v; break;
+    case NodeOp::blend:      s << "blend"; break;
+    }
+    return s.str();
+}
+
+NoiseKernel
+NoiseGraph::compile(Node output) const
+{
+    p->check(output);
+    // nodes only refer to earlier ones, so a backward pass finds those
+    // output depends on and a forward one puts them in order
+    std::vector<bool> used(output.id + 1);
+    used[output.id] = true;
+    for (int k = output.id; k >= 0; k--)
+        if (used[k])
+            for (int a: p->nodes[k].arg)
+                if (a >= 0)
+                    used[a] = true;
+
+    auto prog = std::make_shared<NoiseKernel::program>();
+    std::vector<int> reg(output.id + 1, -1), source(p->sources.size(), -1);
+    for (int k = 0; k <= output.id; k++) {
+        if (!used[k])
+            continue;
+        GraphNode n = p->nodes[k];
+        for (int& a: n.arg)
+            if (a >= 0)
+                a = reg[a];
+        std::string description;
+        if (n.op == NodeOp::noise) {
+            const GradientNoise& s = p->sources[n.source];
+            if (source[n.source] < 0) {
+                source[n.source] = prog->sources.size();
+                prog->sources.push_back(s);
+            }
+            n.source = source[n.source];
+            std::ostringstream d;
+            d << (s.basis == GradientNoise::Basis::perlin ? "perlin"
+                                                          : "simplex")
+              << (s.fractal == GradientNoise::Fractal::sum ? " sum"
+                                                           : " ridged")
+              << ", " << s.octaves << " octaves";
+            description = d.str();
+        }
+        reg[k] = prog->code.size();
+        prog->code.push_back(n);
+        prog->names.push_back(node_name(n, description));
+    }
+    prog->output = reg[output.id];
+    return NoiseKernel(prog);
+}
+
+template<int D, typename Vec>
+void
+NoiseKernel::program::run(span<const Vec> points, span<double> out,
+                          std::vector<double>* ns) const
+{
+    if (points.size() != out.size())
+        throw std::invalid_argument("NoiseKernel: sizes differ");
+    const size_t block = graph_block;
+    std::vector<double> regs(code.size() * block);
+    std::vector<Vec> moved(block);
+    // constants never change, so they are written once
+    for (size_t k = 0; k < code.size(); k++)
+        if (code[k].op == NodeOp::constant)
+            std::fill_n(&regs[k * block], block, code[k].u);
+
+    for (size_t i = 0; i < points.size(); i += block) {
+        size_t n = std::min(points.size() - i, block);
+        for (size_t k = 0; k < code.size(); k++) {
+            const GraphNode& c = code[k];
+            double* r = &regs[k * block];
+            const double* in[3];
+            for (int a = 0; a < 3; a++)
+                in[a] = c.arg[a] >= 0 ? &regs[c.arg[a] * block] : nullptr;
+            auto start = ns ? std::chrono::steady_clock::now()
+                            : std::chrono::steady_clock::time_point();
+
+            switch (c.op) {
+            case NodeOp::constant:
+                break;
+            case NodeOp::coordinate:
+                for (size_t j = 0; j < n; j++)
+                    r[j] = c.source < D ? points[i + j][c.source] : 0;
+                break;
+            case NodeOp::noise:
+                for (size_t j = 0; j < n; j++) {
+                    Vec q = points[i + j];
+                    for (int d = 0; d < D; d++)
+                        if (in[d])
+                            q[d] += in[d][j];
+                    moved[j] = q;
+                }
+                sources[c.source](span<const Vec>(moved.data(), n),
+                                  span<double>(r, n));
+                break;
+            case NodeOp::add:
+                for (size_t j = 0; j < n; j++)
+                    r[j] = in[0][j] + in[1][j];
+                break;
+            case NodeOp::subtract:
+                for (size_t j = 0; j < n; j++)
+                    r[j] = in[0][j] - in[1][j];
+                break;
+            case NodeOp::multiply:
+                for (size_t j = 0; j < n; j++)
+                    r[j] = in[0][j] * in[1][j];
+                break;
+            case NodeOp::affine:
+                for (size_t j = 0; j < n; j++)
+                    r[j] = in[0][j] * c.u + c.v;
+                break;
+            case NodeOp::abs:
+                for (size_t j = 0; j < n; j++)
+                    r[j] = with_sign(in[0][j], 1.);
+                break;
+            case NodeOp::min:
+                for (size_t j = 0; j < n; j++)
+                    r[j] = blend(mask<uint64_t>(in[1][j] < in[0][j]),
+                                 in[1][j], in[0][j]);
+                break;
+            case NodeOp::max:
+                for (size_t j = 0; j < n; j++)
+                    r[j] = blend(mask<uint64_t>(in[0][j] < in[1][j]),
+                                 in[1][j], in[0][j]);
+                break;
+            case NodeOp::clamp:
+                for (size_t j = 0; j < n; j++) {
+                    double x = in[0][j];
+                    x = blend(mask<uint64_t>(x < c.u), c.u, x);
+                    r[j] = blend(mask<uint64_t>(c.v < x), c.v, x);
+                }
+                break;
+            case NodeOp::blend:
+                for (size_t j = 0; j < n; j++)
+                    r[j] = in[0][j] + (in[1][j] - in[0][j]) * in[2][j];
+                break;
+            }
+
+            if (ns)
+                (*ns)[k] += std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start).count();
+        }
+        std::copy_n(&regs[output * block], n, &out[i]);
+    }
+}
+
+double
+NoiseKernel::operator()(dvec2 v) const
+{
+    double out;
+    p->run<2>(span<const dvec2>(&v, 1), span<double>(&out, 1), nullptr);
+    return out;
+}
+
+double
+NoiseKernel::operator()(dvec3 v) const
+{
+    double out;
+    p->run<3>(span<const dvec3>(&v, 1), span<double>(&out, 1), nullptr);
+    return out;
+}
+
+void
+NoiseKernel::operator()(span<const dvec2> points, span<double> out) const
+{
+    p->run<2>(points, out, nullptr);
+}
+
+void
+NoiseKernel::operator()(span<const dvec3> points, span<double> out) const
+{
+    p->run<3>(points, out, nullptr);
+}
+
+void
+NoiseKernel::fill(Image<double>& image, dvec2 origin, dvec2 step,
+                  Parallel parallel) const
+{
+    fill_rows(image, parallel, [&](int y, span<double> row) {
+        std::vector<dvec2> points(row.size());
+        for (size_t x = 0; x < row.size(); x++)
+            points[x] = grid_point(origin, step, x, y);
+        p->run<2>(span<const dvec2>(points), row, nullptr);
+    });
+}
+
+void
+NoiseKernel::fill(Image<double>& image, dvec3 origin, dvec3 dx, dvec3 dy,
+                  Parallel parallel) const
+{
+    fill_rows(image, parallel, [&](int y, span<double> row) {
+        std::vector<dvec3> points(row.size());
+        for (size_t x = 0; x < row.size(); x++)
+            points[x] = grid_point(origin, dx, dy, x, y);
+        p->run<3>(span<const dvec3>(points), row, nullptr);
+    });
+}
+
+int
+NoiseKernel::size() const
+{
+    return p->code.size();
+}
+
+template<int D, typename Vec>
+std::vector<NoiseKernel::NodeCost>
+NoiseKernel::program::profile(span<const Vec> points) const
+{
+    std::vector<double> ns(code.size()), out(points.size());
+    run<D>(points, span<double>(out), &ns);
+    std::vector<NodeCost> costs;
+    for (size_t k = 0; k < ns.size(); k++)
+        costs.push_back({ names[k],
+                          points.empty() ? 0 : ns[k] / points.size() });
+    return costs;
+}
+
+std::vector<NoiseKernel::NodeCost>
+NoiseKernel::profile(span<const dvec2> points) const
+{
+    return p->profile<2>(points);
+}
+
+std::vector<NoiseKernel::NodeCost>
+NoiseKernel::profile(span<const dvec3> points) const
+{
+    return p->profile<3>(points);
+}
@@ -62,3 +62,4 @@ error_check::~error_check() noexcept(false) {
 
 
 int detail::current_context_iteration;
+bool detail::default_framebuffer_srgb;
@@ -29,6 +29,10 @@ namespace detail {
 // during the lifetime of our proxies
 extern int current_context_iteration;
 
+// whether the window asked for sRGB encoding in the default framebuffer,
+// which Framebuffer::unbind() restores
+extern bool default_framebuffer_srgb;
+
 // common base class for all OpenGL proxies
 template<typename Derived>
 class Object {
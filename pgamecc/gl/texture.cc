@@ -87,13 +87,103 @@ image_data(const pgamecc::Image<pgamecc::color::RGB>& image)
     return move(data);
 }
 
+// before anything is bound, so that a throw leaves no GL state behind
+static void
+check_levels(size_t levels)
+{
+    if (!levels)
+        throw logic_error("texture needs at least one level");
+}
+
+static void
+set_levels(size_t levels)
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+}
+
 void
 Texture::load(const Image<color::RGB>& image)
+{
+    load_rgb(image.size(), &image_data(image)[0]);
+}
+
+void
+Texture::load_rgb(ivec2 size, const GLfloat* data)
 {
     error_check ec("Texture::load");
     bind(0);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.size().x, image.size().y, 0,
-                 GL_RGB, GL_FLOAT, &image_data(image)[0]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, sizeof(GLfloat));
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x, size.y, 0,
+                 GL_RGB, GL_FLOAT, data);
+    set_levels(1);
+    unbind(0);
+}
+
+void
+Texture::load_packed(Packed format, size_t levels,
+                     const ivec2* sizes, const void* const* data,
+                     int row_length)
+{
+    error_check ec("Texture::load");
+    check_levels(levels);
+    bind(0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, format.alignment);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+    for (size_t i = 0; i < levels; i++)
+        glTexImage2D(GL_TEXTURE_2D, i, format.internal,
+                     sizes[i].x, sizes[i].y, 0,
+                     format.format, format.type, data[i]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    set_levels(levels);
+    unbind(0);
+}
+
+void
+Texture::load_packed_at(Packed format, ivec2 size, const void* data,
+                        ivec2 at, int row_length)
+{
+    error_check ec("Texture::load_at");
+    bind(0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, format.alignment);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, at.x, at.y, size.x, size.y,
+                    format.format, format.type, data);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    unbind(0);
+}
+
+void
+Texture::load_mipmaps(const vector<Image<color::RGB>>& levels)
+{
+    error_check ec("Texture::load_mipmaps");
+    check_levels(levels.size());
+    bind(0);
+    for (size_t i = 0; i < levels.size(); i++)
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGB,
+                     levels[i].size().x, levels[i].size().y, 0,
+                     GL_RGB, GL_FLOAT, &image_data(levels[i])[0]);
+    set_levels(levels.size());
+    unbind(0);
+}
+
+void
+Texture::load_mipmaps(const vector<Image<double>>& levels)
+{
+    error_check ec("Texture::load_mipmaps");
+    check_levels(levels.size());
+    bind(0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, sizeof(GLfloat));
+    for (size_t i = 0; i < levels.size(); i++) {
+        auto& pixels = levels[i].pixels();
+        vector<GLfloat> data(begin(pixels), end(pixels));
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RED,
+                     levels[i].size().x, levels[i].size().y, 0,
+                     GL_RED, GL_FLOAT, data.data());
+    }
+    set_levels(levels.size());
     unbind(0);
 }
 
@@ -122,6 +212,66 @@ Texture::load_at(const Image<double>& image, ivec2 at)
     unbind(0);
 }
 
+void
+Texture::load_at(const Image<color::RGB>& image, irect region)
+{
+    load_at(image.view(region), region.min);
+}
+
+void
+Texture::load_at(const Image<double>& image, irect region)
+{
+    load_at(image.view(region), region.min);
+}
+
+// GL_RGB or GL_RED floats of the view, converted row by row
+static void
+load_view_data(pgamecc::ivec2 size, GLenum format, const GLfloat* data,
+               const pgamecc::ivec2* at)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, sizeof(GLfloat));
+    if (!at) {
+        glTexImage2D(GL_TEXTURE_2D, 0, format, size.x, size.y, 0,
+                     format, GL_FLOAT, data);
+        set_levels(1);
+    } else if (size.x && size.y)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, at->x, at->y, size.x, size.y,
+                        format, GL_FLOAT, data);
+}
+
+void
+Texture::load_view(ImageView<const color::RGB> view, const ivec2* at)
+{
+    vector<GLfloat> data;
+    data.reserve((size_t)view.size().x * view.size().y * 3);
+    for (int y = 0; y < view.size().y; y++)
+        for (auto c: view.row(y)) {
+            data.push_back(c.r);
+            data.push_back(c.g);
+            data.push_back(c.b);
+        }
+
+    error_check ec(at ? "Texture::load_at" : "Texture::load");
+    bind(0);
+    load_view_data(view.size(), GL_RGB, data.data(), at);
+    unbind(0);
+}
+
+void
+Texture::load_view(ImageView<const double> view, const ivec2* at)
+{
+    vector<GLfloat> data;
+    data.reserve((size_t)view.size().x * view.size().y);
+    for (int y = 0; y < view.size().y; y++) {
+        auto row = view.row(y);
+        data.insert(data.end(), row.begin(), row.end());
+    }
+
+    error_check ec(at ? "Texture::load_at" : "Texture::load");
+    bind(0);
+    load_view_data(view.size(), GL_RED, data.data(), at);
+    unbind(0);
+}
 
 void
 Texture::clear_red(ivec2 size, double color)
@@ -141,11 +291,12 @@ Texture::clear_red(ivec2 size, double color)
 
 
 static void
-reset_texture(const Texture& texture, pgamecc::ivec2 size, GLenum format)
+reset_texture(const Texture& texture, pgamecc::ivec2 size,
+              GLenum internal, GLenum format)
 {
     error_check ec("Texture::reset");
     texture.bind(0);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, size.x, size.y, 0,
+    glTexImage2D(GL_TEXTURE_2D, 0, internal, size.x, size.y, 0,
                  format, GL_FLOAT, nullptr);
     texture.unbind(0);
 }
@@ -153,19 +304,58 @@ reset_texture(const Texture& texture, pgamecc::ivec2 size, GLenum format)
 void
 Texture::reset_rgb(ivec2 size)
 {
-    reset_texture(*this, size, GL_RGB);
+    reset_texture(*this, size, GL_RGB, GL_RGB);
 }
 
 void
 Texture::reset_rgba(ivec2 size)
 {
-    reset_texture(*this, size, GL_RGBA);
+    reset_texture(*this, size, GL_RGBA, GL_RGBA);
+}
+
+void
+Texture::reset_srgb(ivec2 size)
+{
+    reset_texture(*this, size, GL_SRGB8, GL_RGB);
+}
+
+void
+Texture::reset_srgb_alpha(ivec2 size)
+{
+    reset_texture(*this, size, GL_SRGB8_ALPHA8, GL_RGBA);
 }
 
 void
 Texture::reset_depth(ivec2 size)
 {
-    reset_texture(*this, size, GL_DEPTH_COMPONENT);
+    reset_texture(*this, size, GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT);
+}
+
+
+static ColorEncoding
+encoding_of(GLint internal)
+{
+    switch (internal) {
+    case GL_SRGB:
+    case GL_SRGB8:
+    case GL_SRGB_ALPHA:
+    case GL_SRGB8_ALPHA8:
+        return ColorEncoding::srgb;
+    default:
+        return ColorEncoding::linear;
+    }
+}
+
+ColorEncoding
+Texture::encoding() const
+{
+    error_check ec("Texture::encoding");
+    bind(0);
+    GLint internal;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0,
+                             GL_TEXTURE_INTERNAL_FORMAT, &internal);
+    unbind(0);
+    return encoding_of(internal);
 }
 
 
@@ -285,11 +475,21 @@ Object<Framebuffer>::destroy()
 }}}
 
 
+static void
+framebuffer_srgb(bool enable)
+{
+    if (enable)
+        glEnable(GL_FRAMEBUFFER_SRGB);
+    else
+        glDisable(GL_FRAMEBUFFER_SRGB);
+}
+
 void
 Framebuffer::bind() const
 {
     error_check ec("Framebuffer::bind");
     glBindFramebuffer(GL_FRAMEBUFFER, object);
+    framebuffer_srgb(color_encoding == ColorEncoding::srgb);
 }
 
 void
@@ -297,6 +497,7 @@ Framebuffer::unbind()
 {
     error_check ec("Framebuffer::unbind");
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    framebuffer_srgb(detail::default_framebuffer_srgb);
 }
 
 
@@ -307,6 +508,12 @@ Framebuffer::attach_color(const Texture& texture)
     bind();
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                            GL_TEXTURE_2D, texture.object, 0);
+    GLint encoding;
+    glGetFramebufferAttachmentParameteriv(
+        GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_FRAMEBUFFER_ATTACHMENT_COLOR_ENCODING, &encoding);
+    color_encoding = encoding == GL_SRGB ? ColorEncoding::srgb
+                                         : ColorEncoding::linear;
     unbind();
 }
 
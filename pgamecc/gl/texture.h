@@ -4,7 +4,13 @@
 #include "common.h"
 
 #include <pgamecc/color.h>
+#include <pgamecc/dirty.h>
 #include <pgamecc/image.h>
+#include <pgamecc/pixel.h>
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 
 namespace pgamecc {
@@ -12,6 +18,69 @@ namespace gl {
 
 class Framebuffer;
 
+// Color encoding of a texture or framebuffer attachment. sRGB textures are
+// decoded to linear light when sampled, and with sRGB attachments blending
+// happens in linear light and the result is encoded when written.
+enum class ColorEncoding { linear, srgb };
+
+namespace detail {
+
+// OpenGL formats for PackedRGB channels
+template<typename Channel>
+struct channel_format;
+
+template<> struct channel_format<float> {
+    static constexpr GLenum type = GL_FLOAT, internal = GL_RGB32F;
+};
+template<> struct channel_format<half> {
+    static constexpr GLenum type = GL_HALF_FLOAT, internal = GL_RGB16F;
+};
+template<> struct channel_format<unorm16> {
+    static constexpr GLenum type = GL_UNSIGNED_SHORT, internal = GL_RGB16;
+};
+template<> struct channel_format<unorm8> {
+    static constexpr GLenum type = GL_UNSIGNED_BYTE, internal = GL_RGB8;
+};
+template<> struct channel_format<srgb8> {
+    static constexpr GLenum type = GL_UNSIGNED_BYTE, internal = GL_SRGB8;
+};
+
+// OpenGL formats for pixels uploaded as stored, without conversion
+template<typename Pixel>
+struct pixel_format {
+    static constexpr bool packed = false;
+};
+
+template<typename Channel>
+struct pixel_format<PackedRGB<Channel>> {
+    static_assert(sizeof(PackedRGB<Channel>) == 3 * sizeof(Channel),
+                  "PackedRGB must not be padded");
+    static constexpr bool packed = true;
+    static constexpr GLenum internal = channel_format<Channel>::internal,
+                            format = GL_RGB,
+                            type = channel_format<Channel>::type;
+    // rows are a whole number of channels, so channel alignment is enough
+    static constexpr int alignment = sizeof(Channel);
+};
+// float colors have the layout of RGB32F
+template<> struct pixel_format<color::RGBf> : pixel_format<PackedRGB<float>> {
+    static_assert(sizeof(color::RGBf) == 3 * sizeof(float),
+                  "color::RGBf must not be padded");
+};
+template<> struct pixel_format<SRGB8_ALPHA8> {
+    static_assert(sizeof(SRGB8_ALPHA8) == 4, "SRGB8_ALPHA8 must be 4 bytes");
+    static constexpr bool packed = true;
+    static constexpr GLenum internal = GL_SRGB8_ALPHA8, format = GL_RGBA,
+                            type = GL_UNSIGNED_BYTE;
+    static constexpr int alignment = 4;
+};
+
+// void, for overloads that take pixels with a pixel_format
+template<typename Pixel>
+using if_packed = std::enable_if_t<pixel_format<Pixel>::packed>;
+
+}
+
 class Texture : public detail::Object<Texture> {
 public:
     Texture();
@@ -21,16 +90,153 @@ public:
     static void unbind(int unit);
 
     void load(const Image<color::RGB>& image);
+    // evaluated straight into the upload buffer
+    template<typename Expr>
+    void load(const ImageExpr<Expr>& image);
+    // all levels starting with 0, e.g. from mip_pyramid()
+    void load_mipmaps(const std::vector<Image<color::RGB>>& levels);
+    void load_mipmaps(const std::vector<Image<double>>& levels);
     void load_at(const Image<color::RGB>& image, ivec2 at);
     void load_at(const Image<double>& image, ivec2 at);
+    // Packed pixels, RGBf and SRGB8_ALPHA8 are uploaded as stored, without
+    // conversion. SRGB8 and SRGB8_ALPHA8 make sRGB textures.
+    template<typename Pixel>
+    detail::if_packed<Pixel> load(const Image<Pixel>& image);
+    template<typename Pixel>
+    detail::if_packed<Pixel> load_mipmaps(
+        const std::vector<Image<Pixel>>& levels);
+    template<typename Pixel>
+    detail::if_packed<Pixel> load_at(const Image<Pixel>& image, ivec2 at);
+    // Re-uploads part of an image already loaded at the same size, to the
+    // same place in the texture, e.g. after remake_image().
+    void load_at(const Image<color::RGB>& image, irect region);
+    void load_at(const Image<double>& image, irect region);
+    template<typename Pixel>
+    detail::if_packed<Pixel> load_at(const Image<Pixel>& image, irect region);
+    template<typename Color>
+    void load_at(const Image<Color>& image, const DirtyRegion& dirty) {
+        for (auto region: dirty.rects())
+            load_at(image, region);
+    }
+    // Views of RGB, double or packed pixels, e.g. a tile of a larger image or
+    // a MappedImage. Packed pixels are read in place, with the stride passed
+    // as GL_UNPACK_ROW_LENGTH.
+    template<typename T>
+    void load(ImageView<T> view) {
+        load_view(ImageView<const std::remove_const_t<T>>(view), nullptr);
+    }
+    template<typename T>
+    void load_at(ImageView<T> view, ivec2 at) {
+        load_view(ImageView<const std::remove_const_t<T>>(view), &at);
+    }
     void clear_red(ivec2 size, double color = 0);
     void reset_rgb(ivec2 size); // contents undefined
     void reset_rgba(ivec2 size); // contents undefined
+    void reset_srgb(ivec2 size); // contents undefined
+    void reset_srgb_alpha(ivec2 size); // contents undefined
     void reset_depth(ivec2 size); // contents undefined
 
+    // from the internal format of level 0
+    ColorEncoding encoding() const;
+
+private:
+    void load_rgb(ivec2 size, const GLfloat* data);
+
+    // pixels with the given formats and row alignment in bytes
+    struct Packed {
+        GLenum internal, format, type;
+        int alignment;
+
+        template<typename Pixel>
+        static Packed of() {
+            typedef detail::pixel_format<Pixel> f;
+            return { f::internal, f::format, f::type, f::alignment };
+        }
+    };
+    // row_length is the stride of a view, 0 for contiguous rows
+    void load_packed(Packed format, size_t levels,
+                     const ivec2* sizes, const void* const* data,
+                     int row_length = 0);
+    void load_packed_at(Packed format, ivec2 size, const void* data,
+                        ivec2 at, int row_length = 0);
+
+    // full load if at is null
+    void load_view(ImageView<const color::RGB> view, const ivec2* at);
+    void load_view(ImageView<const double> view, const ivec2* at);
+    template<typename Pixel>
+    detail::if_packed<Pixel> load_view(ImageView<const Pixel> view,
+                                       const ivec2* at);
+
     friend class Framebuffer;
 };
 
+template<typename Pixel>
+detail::if_packed<Pixel>
+Texture::load(const Image<Pixel>& image)
+{
+    ivec2 size = image.size();
+    const void* data = image.pixels().data();
+    load_packed(Packed::of<Pixel>(), 1, &size, &data);
+}
+
+template<typename Pixel>
+detail::if_packed<Pixel>
+Texture::load_mipmaps(const std::vector<Image<Pixel>>& levels)
+{
+    std::vector<ivec2> sizes;
+    std::vector<const void*> data;
+    for (auto& level: levels) {
+        sizes.push_back(level.size());
+        data.push_back(level.pixels().data());
+    }
+    load_packed(Packed::of<Pixel>(), levels.size(),
+                sizes.data(), data.data());
+}
+
+template<typename Pixel>
+detail::if_packed<Pixel>
+Texture::load_at(const Image<Pixel>& image, ivec2 at)
+{
+    load_packed_at(Packed::of<Pixel>(), image.size(),
+                   image.pixels().data(), at);
+}
+
+template<typename Pixel>
+detail::if_packed<Pixel>
+Texture::load_at(const Image<Pixel>& image, irect region)
+{
+    load_at(image.view(region), region.min);
+}
+
+template<typename Pixel>
+detail::if_packed<Pixel>
+Texture::load_view(ImageView<const Pixel> view, const ivec2* at)
+{
+    ivec2 size = view.size();
+    const void* data = view.data();
+    if (!at)
+        load_packed(Packed::of<Pixel>(), 1, &size, &data, view.stride());
+    else if (size.x && size.y)
+        load_packed_at(Packed::of<Pixel>(), size, data, *at, view.stride());
+}
+
+template<typename Expr>
+void
+Texture::load(const ImageExpr<Expr>& image)
+{
+    ivec2 size = image.size();
+    std::unique_ptr<GLfloat[]> data(new GLfloat[(size_t)size.x * size.y * 3]);
+    GLfloat* d = data.get();
+    for (int y = 0; y < size.y; y++)
+        for (int x = 0; x < size.x; x++) {
+            auto c = image.expr().at(ivec2(x, y));
+            *d++ = c.r;
+            *d++ = c.g;
+            *d++ = c.b;
+        }
+    load_rgb(size, data.get());
+}
+
 
 class Sampler : public detail::Object<Sampler> {
 public:
@@ -55,7 +261,11 @@ public:
 };
 
 
+// Binding a framebuffer with an sRGB color attachment enables
+// GL_FRAMEBUFFER_SRGB, and unbinding restores the setting of the window.
 class Framebuffer : public detail::Object<Framebuffer> {
+    ColorEncoding color_encoding = ColorEncoding::linear;
+
 public:
     Framebuffer();
     Framebuffer(const Texture&, const Renderbuffer&);
@@ -63,7 +273,9 @@ public:
     void bind() const;
     static void unbind();
 
+    // the encoding is that of the texture, e.g. from reset_srgb_alpha()
     void attach_color(const Texture&);
+    ColorEncoding encoding() const { return color_encoding; }
     void attach_depth(const Texture&);
     void attach_depth(const Renderbuffer&);
     void check() const;
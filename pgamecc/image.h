@@ -1,16 +1,25 @@
 #ifndef PGAMECC_IMAGE_H
 #define PGAMECC_IMAGE_H
 
+#include <pgamecc/sampler.h>
 #include <pgamecc/types.h>
+#include <pgamecc/util.h>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <iterator>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <type_traits>
 #include <vector>
 
 namespace pgamecc {
 
+template<typename Color>
+class BakedGradient;
+
 template<typename Color>
 class Gradient {
     std::map<double, Color> points;
@@ -33,107 +42,932 @@ public:
     Color& operator[](double v) {
         return points.insert(std::make_pair(v, (*this)(v))).first->second;
     }
+
+    // lookup table for fast evaluation, see BakedGradient
+    BakedGradient<Color> bake(int resolution = 1024) const;
 };
 
 
 
-template<typename Color>
+// Storage layouts for Image pixels. A layout is constructed for an image size
+// and maps pixel coordinates to offsets in the pixel vector. Rows are grouped
+// in blocks of row_block rows which don't share storage with other blocks.
+
+// rows stored one after another, as expected by OpenGL
+struct RowMajor {
+    static constexpr bool row_major = true;
+    static constexpr int row_block = 1;
+
+    size_t width;
+
+    explicit RowMajor(ivec2 size) : width(size.x) {}
+
+    static size_t storage(ivec2 size) { return (size_t)size.x * size.y; }
+    size_t offset(ivec2 i) const { return i.x + i.y * width; }
+};
+
+// square tiles of N x N pixels, with tiles and pixels within tiles row-major
+template<int N>
+struct Tiled {
+    static_assert(N > 0 && (N & N-1) == 0, "tile size must be a power of two");
+
+    static constexpr bool row_major = false;
+    static constexpr int row_block = N;
+
+    size_t tiles_x;
+
+    explicit Tiled(ivec2 size) : tiles_x((size.x + N-1) / N) {}
+
+    static size_t storage(ivec2 size) {
+        return (size_t)((size.x + N-1) / N) * ((size.y + N-1) / N) * N * N;
+    }
+    size_t offset(ivec2 i) const {
+        unsigned x = i.x, y = i.y;
+        return ((y / N) * tiles_x + x / N) * (N * N) + (y % N) * N + x % N;
+    }
+};
+
+// Z-order curve, so nearby pixels in both directions are nearby in memory.
+// Each axis is padded to a power of two; bits are interleaved up to the size
+// of the shorter axis and the remaining bits of the longer axis are on top.
+struct Morton {
+    static constexpr bool row_major = false;
+    static constexpr int row_block = 8;
+
+    int bits;    // interleaved bits of each coordinate
+    bool long_x; // x has the extra bits
+
+    explicit Morton(ivec2 size) {
+        int bx = log2_ceil(size.x), by = log2_ceil(size.y);
+        bits = std::min(bx, by);
+        long_x = bx > by;
+    }
+
+    static size_t storage(ivec2 size) {
+        if (size.x <= 0 || size.y <= 0)
+            return 0;
+        return (size_t)1 << (log2_ceil(size.x) + log2_ceil(size.y));
+    }
+    size_t offset(ivec2 i) const {
+        uint64_t x = (unsigned)i.x, y = (unsigned)i.y;
+        uint64_t mask = ((uint64_t)1 << bits) - 1;
+        return spread(x & mask) | spread(y & mask) << 1 |
+               (long_x ? x : y) >> bits << 2*bits;
+    }
+
+private:
+    static int log2_ceil(int n) {
+        int b = 0;
+        while (b < 31 && 1 << b < n)
+            b++;
+        return b;
+    }
+
+    // insert a zero bit above each bit
+    static uint64_t spread(uint64_t v) {
+        v = (v | v << 16) & 0x0000ffff0000ffff;
+        v = (v | v <<  8) & 0x00ff00ff00ff00ff;
+        v = (v | v <<  4) & 0x0f0f0f0f0f0f0f0f;
+        v = (v | v <<  2) & 0x3333333333333333;
+        v = (v | v <<  1) & 0x5555555555555555;
+        return v;
+    }
+};
+
+
+template<typename Color, typename Layout = RowMajor>
 class Image;
 
+template<typename T>
+class ImageView;
+
+template<typename Expr>
+class ImageExpr;
+
+// Requests construction of an Image on several threads. The function must be
+// safe to call concurrently; the result is identical to serial construction.
+struct Parallel {
+    int threads; // 0 for default_threads()
+
+    explicit Parallel(int threads = 0) : threads(threads) {}
+};
+
+// Type that samplers, filters and expressions compute with for pixels of type
+// Color. Compact storage types such as PackedRGB convert to a wider type here,
+// so arithmetic is never done in the storage precision.
+template<typename Color>
+struct sample_type { typedef Color type; };
+
+template<typename Color>
+using sample_type_t = typename sample_type<Color>::type;
+
 namespace detail {
 
+// whether f can be called with arguments of the given types
+template<typename Func, typename Signature, typename = void>
+struct is_callable : std::false_type {};
+
+template<typename Func, typename... Args>
+struct is_callable<Func, void(Args...), decltype(void(
+    std::declval<const Func&>()(std::declval<Args>()...)))> :
+    std::true_type {};
+
 // helper to call constructor for correct type
-template<typename Func>
+template<typename Func, typename... Mode>
 auto
-make_image_sized(ivec2 size, const Func& f) ->
+make_image_sized(ivec2 size, const Func& f, Mode... mode) ->
     Image<std::remove_reference_t<decltype(f(size))>>
 {
-    return { size, f };
+    return { size, f, mode... };
 }
 
+// coordinates passed to make_image functions
+inline dvec2
+pixel_center(ivec2 i, ivec2 size)
+{
+    return (dvec2(i)+.5)/dvec2(size);
 }
 
-template<typename Color>
+// pixels passed to a batch function at once, keeping coordinates in L1 cache
+constexpr int batch_width = 256;
+
+// random access iterator over every stride-th element, e.g. an Image column
+template<typename T>
+class StridedIterator {
+    T* p;
+    std::ptrdiff_t stride;
+
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef std::remove_const_t<T> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T* pointer;
+    typedef T& reference;
+
+    StridedIterator() : p(nullptr), stride(1) {}
+    StridedIterator(T* p, std::ptrdiff_t stride) : p(p), stride(stride) {}
+
+    T& operator*() const { return *p; }
+    T* operator->() const { return p; }
+    T& operator[](std::ptrdiff_t n) const { return p[n * stride]; }
+
+    StridedIterator& operator++() { p += stride; return *this; }
+    StridedIterator& operator--() { p -= stride; return *this; }
+    StridedIterator operator++(int) { auto r = *this; ++*this; return r; }
+    StridedIterator operator--(int) { auto r = *this; --*this; return r; }
+    StridedIterator& operator+=(std::ptrdiff_t n) {
+        p += n * stride; return *this;
+    }
+    StridedIterator& operator-=(std::ptrdiff_t n) {
+        p -= n * stride; return *this;
+    }
+    StridedIterator operator+(std::ptrdiff_t n) const {
+        auto r = *this; return r += n;
+    }
+    StridedIterator operator-(std::ptrdiff_t n) const {
+        auto r = *this; return r -= n;
+    }
+    friend StridedIterator operator+(std::ptrdiff_t n, StridedIterator it) {
+        return it += n;
+    }
+    std::ptrdiff_t operator-(StridedIterator it) const {
+        return (p - it.p) / stride;
+    }
+
+    bool operator==(StridedIterator it) const { return p == it.p; }
+    bool operator!=(StridedIterator it) const { return p != it.p; }
+    bool operator< (StridedIterator it) const { return *this - it <  0; }
+    bool operator> (StridedIterator it) const { return *this - it >  0; }
+    bool operator<=(StridedIterator it) const { return *this - it <= 0; }
+    bool operator>=(StridedIterator it) const { return *this - it >= 0; }
+};
+
+template<typename T>
+struct StridedRange {
+    StridedIterator<T> first, last;
+
+    StridedIterator<T> begin() const { return first; }
+    StridedIterator<T> end() const { return last; }
+    size_t size() const { return last - first; }
+    T& operator[](size_t i) const { return first[i]; }
+};
+
+}
+
+template<typename Color, typename Layout>
 class Image {
+public:
+    typedef Color value_type;
+    typedef Layout layout_type;
+    typedef sample_type_t<Color> sample_type;
+    // storage aligned to a cache line; this is not std::vector<Color>, so
+    // code naming the type of pixels() should use pixel_vector
+    typedef std::vector<Color, AlignedAllocator<Color>> pixel_vector;
+
+private:
     ivec2 _size;
-    std::vector<Color> _pixels;
+    Layout _layout;
+    pixel_vector _pixels;
 
 public:
+
+    // Func is called either per pixel as f(ivec2 i) -> Color, or per row as
+    // f(ivec2 start, span<Color> row) to fill row.size() pixels to the right
+    // of start. Values are converted to Color as they are written, so compact
+    // pixel types can be filled from functions returning e.g. color::RGB.
     Image(ivec2 size) :
-        _size(size), _pixels((size_t)size.x * size.y) {}
+        _size(size), _layout(size), _pixels(Layout::storage(size)) {}
 
     template<typename Func>
     Image(ivec2 size, const Func& f) :
-        _size(size)
+        Image(size)
     {
-        _pixels.reserve((size_t)size.x * size.y);
-        for (int y = 0; y < size.y; y++)
-            for (int x = 0; x < size.x; x++)
-                _pixels.push_back(f(ivec2(x, y)));
+        fill_rows(0, size.y, f);
     }
 
+    template<typename Func>
+    Image(ivec2 size, const Func& f, Parallel parallel) :
+        Image(size)
+    {
+        // threads work on whole row blocks to avoid false sharing
+        int b = Layout::row_block;
+        parallel_bands((size.y + b-1) / b, parallel.threads,
+            [&](int b0, int b1) {
+                fill_rows(b0 * b, std::min(b1 * b, size.y), f);
+            });
+    }
+
+    // converts between layouts and pixel types
+    template<typename OtherColor, typename OtherLayout>
+    explicit Image(const Image<OtherColor, OtherLayout>& image) :
+        Image(image.size(), [&](ivec2 i) { return Color(image.at_unsafe(i)); })
+    {}
+
+    // evaluates an expression in a single pass
+    template<typename Expr>
+    Image(const ImageExpr<Expr>& e) :
+        Image(e.size(), [&](ivec2 i) { return e.expr().at(i); }) {}
+
+    template<typename Expr>
+    Image(const ImageExpr<Expr>& e, Parallel parallel) :
+        Image(e.size(), [&](ivec2 i) { return e.expr().at(i); }, parallel) {}
+
+    // Expressions only read each pixel at its own position, so an expression
+    // using this image can be evaluated in place.
+    template<typename Expr>
+    Image& operator=(const ImageExpr<Expr>& e) {
+        if (e.size() != _size)
+            return *this = Image(e);
+        fill_rows(0, _size.y, [&](ivec2 i) { return e.expr().at(i); });
+        return *this;
+    }
+
+    // Recomputes only the pixels in region, calling f as in the constructor.
+    // Row functions get rows of the region, starting at region.min.x.
+    template<typename Func>
+    void fill(irect region, const Func& f) {
+        if (!irect{ivec2(0), _size}.contains(region))
+            throw std::out_of_range("region outside Image bounds");
+        if (!region.empty())
+            fill_rect(region, f);
+    }
+
+private:
+    template<typename Func>
+    void fill_rows(int y0, int y1, const Func& f) {
+        fill_rect({ivec2(0, y0), ivec2(_size.x, y1)}, f);
+    }
+
+    template<typename Func>
+    void fill_rect(irect r, const Func& f) {
+        fill_rect(r, f,
+                  detail::is_callable<Func, void(ivec2, span<Color>)>{});
+    }
+
+    template<typename Func>
+    void fill_rect(irect r, const Func& f, std::false_type) {
+        for (int y = r.min.y; y < r.max.y; y++)
+            for (int x = r.min.x; x < r.max.x; x++)
+                _pixels[_layout.offset(ivec2(x, y))] = f(ivec2(x, y));
+    }
+
+    template<typename Func>
+    void fill_rect(irect r, const Func& f, std::true_type) {
+        // other layouts go through a row buffer
+        int w = r.size().x;
+        if (w <= 0)
+            return;
+        std::vector<Color> buffer(Layout::row_major ? 0 : w);
+        for (int y = r.min.y; y < r.max.y; y++) {
+            Color* p = Layout::row_major ?
+                _pixels.data() + _layout.offset(ivec2(r.min.x, y)) :
+                buffer.data();
+            f(ivec2(r.min.x, y), span<Color>(p, w));
+            if (!Layout::row_major)
+                for (int x = 0; x < w; x++)
+                    _pixels[_layout.offset(ivec2(r.min.x + x, y))] =
+                        buffer[x];
+        }
+    }
+
+public:
     ivec2 size() const { return _size; }
-    const std::vector<Color>& pixels() const { return _pixels; }
+    // in storage order, which is row by row for the default layout
+    const pixel_vector& pixels() const {
+        return _pixels;
+    }
 
 private:
     size_t offset(ivec2 i) const {
         if (i.x < 0 || i.x >= _size.x || i.y < 0 || i.y >= _size.y)
             throw std::out_of_range("coordinates outside Image bounds");
-        return i.x + i.y * _size.x;
+        return _layout.offset(i);
+    }
+
+    size_t unchecked_offset(ivec2 i) const {
+#ifdef PGAMECC_DEBUG
+        offset(i); // throws
+#endif
+        return _layout.offset(i);
+    }
+
+    // first pixel of a row or column, null if there are no pixels, where
+    // at_unsafe() would index an empty vector
+    const Color* first_of(ivec2 i) const {
+        return _pixels.empty() ? nullptr : &_pixels[unchecked_offset(i)];
+    }
+    Color* first_of(ivec2 i) {
+        return _pixels.empty() ? nullptr : &_pixels[unchecked_offset(i)];
     }
 
 public:
     Color  operator[](ivec2 i) const { return _pixels[offset(i)]; }
     Color& operator[](ivec2 i)       { return _pixels[offset(i)]; }
 
-private:
-    struct SamplerBase {
-        const Image& image;
+    // Unchecked access for hot loops, only checked in debug builds.
+    const Color& at_unsafe(ivec2 i) const {
+        return _pixels[unchecked_offset(i)];
+    }
+    Color& at_unsafe(ivec2 i) { return _pixels[unchecked_offset(i)]; }
 
-        Color sample(ivec2 i) const {
-            return image[glm::clamp(i, ivec2(0), image._size-1)];
-        }
+    // Rows and columns of the default layout, where rows are contiguous and
+    // stored one after another from y = 0. They are empty if the image has
+    // no pixels, e.g. rows of an image of width 0.
+    span<const Color> row(int y) const {
+        static_assert(Layout::row_major, "row() requires RowMajor layout");
+        return { first_of(ivec2(0, y)), (size_t)_size.x };
+    }
+    span<Color> row(int y) {
+        static_assert(Layout::row_major, "row() requires RowMajor layout");
+        return { first_of(ivec2(0, y)), (size_t)_size.x };
+    }
+
+    detail::StridedRange<const Color> column(int x) const {
+        static_assert(Layout::row_major, "column() requires RowMajor layout");
+        detail::StridedIterator<const Color> it{first_of(ivec2(x, 0)),
+                                                _size.x};
+        return { it, it + (_pixels.empty() ? 0 : _size.y) };
+    }
+    detail::StridedRange<Color> column(int x) {
+        static_assert(Layout::row_major, "column() requires RowMajor layout");
+        detail::StridedIterator<Color> it{first_of(ivec2(x, 0)), _size.x};
+        return { it, it + (_pixels.empty() ? 0 : _size.y) };
+    }
+
+    // All pixels row by row. Only for the default layout, since the storage
+    // of tiled and Morton layouts is padded past size().
+    const Color* begin() const {
+        static_assert(Layout::row_major, "begin() requires RowMajor layout");
+        return _pixels.data();
+    }
+    const Color* end() const {
+        static_assert(Layout::row_major, "end() requires RowMajor layout");
+        return _pixels.data() + _pixels.size();
+    }
+    Color* begin() {
+        static_assert(Layout::row_major, "begin() requires RowMajor layout");
+        return _pixels.data();
+    }
+    Color* end() {
+        static_assert(Layout::row_major, "end() requires RowMajor layout");
+        return _pixels.data() + _pixels.size();
+    }
+
+    // Views of all or part of the pixels, which stay valid until the image is
+    // resized or destroyed. Only for the default layout.
+    ImageView<const Color> view() const {
+        static_assert(Layout::row_major, "view() requires RowMajor layout");
+        return { _pixels.data(), _size };
+    }
+    ImageView<Color> view() {
+        static_assert(Layout::row_major, "view() requires RowMajor layout");
+        return { _pixels.data(), _size };
+    }
+    ImageView<const Color> view(irect region) const {
+        return view().view(region);
+    }
+    ImageView<Color> view(irect region) { return view().view(region); }
+
+    // samplers reading this image, see sampler.h
+    NearestSampler<Image> nearest() const {
+        return NearestSampler<Image>(*this);
+    }
+    LinearSampler<Image> linear() const { return LinearSampler<Image>(*this); }
+    CubicSampler<Image> cubic() const { return CubicSampler<Image>(*this); }
+
+public:
+    // Lazy expression reading this image. An rvalue image is moved into the
+    // expression, otherwise the image must outlive the expression.
+    auto expr() const&;
+    auto expr() &&;
+
+    // lazy f(pixel) for each pixel, evaluated when assigned to an Image
+    template<typename Func>
+    auto apply(const Func& f) const& { return expr().apply(f); }
+    template<typename Func>
+    auto apply(const Func& f) && { return std::move(*this).expr().apply(f); }
+};
+
+
+// Non-owning view of pixels stored row by row, with rows stride pixels apart,
+// such as a rectangle of an Image, a MappedImage or a foreign buffer. The
+// pixels must outlive the view. Views are cheap to copy and are copied into
+// samplers and expressions. T is const for read-only views.
+template<typename T>
+class ImageView {
+    T* _data;
+    ivec2 _size;
+    std::ptrdiff_t _stride;
+
+    size_t offset(ivec2 i) const { return i.x + i.y * _stride; }
+
+public:
+    typedef std::remove_const_t<T> value_type;
+    typedef sample_type_t<value_type> sample_type;
+
+    ImageView() : _data(nullptr), _size(0), _stride(0) {}
+    ImageView(T* data, ivec2 size) : ImageView(data, size, size.x) {}
+    ImageView(T* data, ivec2 size, std::ptrdiff_t stride) :
+        _data(data), _size(size), _stride(stride)
+    {
+        if (size.x < 0 || size.y < 0 || stride < size.x)
+            throw std::invalid_argument("ImageView: bad size or stride");
+    }
+
+    // ImageView<T> to ImageView<const T>
+    template<typename U, typename = std::enable_if_t<
+        std::is_convertible<U(*)[], T(*)[]>::value>>
+    ImageView(ImageView<U> v) :
+        _data(v.data()), _size(v.size()), _stride(v.stride()) {}
+
+    ivec2 size() const { return _size; }
+    std::ptrdiff_t stride() const { return _stride; }
+    T* data() const { return _data; }
+
+    T& operator[](ivec2 i) const {
+        if (i.x < 0 || i.x >= _size.x || i.y < 0 || i.y >= _size.y)
+            throw std::out_of_range("coordinates outside ImageView bounds");
+        return _data[offset(i)];
+    }
+
+    // unchecked access, only checked in debug builds
+    T& at_unsafe(ivec2 i) const {
+#ifdef PGAMECC_DEBUG
+        (*this)[i]; // throws
+#endif
+        return _data[offset(i)];
+    }
+
+    span<T> row(int y) const {
+#ifdef PGAMECC_DEBUG
+        if (y < 0 || y >= _size.y)
+            throw std::out_of_range("row outside ImageView bounds");
+#endif
+        return { _data + offset(ivec2(0, y)), (size_t)_size.x };
+    }
+
+    // part of this view, sharing its pixels
+    ImageView view(irect region) const {
+        if (!irect{ivec2(0), _size}.contains(region))
+            throw std::out_of_range("region outside ImageView bounds");
+        if (region.empty())
+            return { _data, ivec2(0), _stride };
+        return { _data + offset(region.min), region.size(), _stride };
+    }
+
+    // copy of the pixels
+    Image<value_type> image() const {
+        return { _size, [&](ivec2 start, span<value_type> out) {
+            auto in = row(start.y);
+            std::copy(in.begin(), in.end(), out.begin());
+        } };
+    }
+
+    NearestSampler<ImageView> nearest() const {
+        return NearestSampler<ImageView>(*this);
+    }
+    LinearSampler<ImageView> linear() const {
+        return LinearSampler<ImageView>(*this);
+    }
+    CubicSampler<ImageView> cubic() const {
+        return CubicSampler<ImageView>(*this);
+    }
+
+    // lazy expression, see ImageExpr
+    auto expr() const;
+    template<typename Func>
+    auto apply(const Func& f) const { return expr().apply(f); }
+};
+
+namespace detail {
+
+template<typename T>
+struct sampler_source<ImageView<T>> { typedef ImageView<T> type; };
+
+}
+
+
+// Lazy image expressions. Image::apply(), arithmetic on images and further
+// apply() calls build an expression tree which is evaluated in one pass over
+// the pixels when converted to an Image, without intermediate images.
+//
+// Each Expr provides size(), value_type and an unchecked at(ivec2).
+
+template<typename Expr>
+class ImageExpr {
+public:
+    const Expr& expr() const { return static_cast<const Expr&>(*this); }
+
+    ivec2 size() const { return expr().size(); }
+
+    auto operator[](ivec2 i) const {
+        if (i.x < 0 || i.x >= size().x || i.y < 0 || i.y >= size().y)
+            throw std::out_of_range("coordinates outside Image bounds");
+        return expr().at(i);
+    }
+
+    // functions are stored by value, use std::cref to avoid copying large ones
+    template<typename Func>
+    auto apply(const Func& f) const;
+
+    auto eval() const {
+        return Image<typename Expr::value_type>(*this);
+    }
+    auto eval(Parallel parallel) const {
+        return Image<typename Expr::value_type>(*this, parallel);
+    }
+};
+
+namespace detail {
+
+// pixels are read as the image's sample_type, by reference if that is the
+// stored type
+template<typename ImageType,
+         typename Sample = typename ImageType::sample_type>
+using image_reference = std::conditional_t<
+    std::is_same<Sample, typename ImageType::value_type>::value,
+    const Sample&, Sample>;
+
+template<typename ImageType>
+class ImageRefExpr : public ImageExpr<ImageRefExpr<ImageType>> {
+    const ImageType* image;
+
+public:
+    typedef typename ImageType::sample_type value_type;
+
+    ImageRefExpr(const ImageType& image) : image(&image) {}
+
+    ivec2 size() const { return image->size(); }
+    image_reference<ImageType> at(ivec2 i) const {
+        return image->at_unsafe(i);
+    }
+};
+
+// shared so that copying the expression doesn't copy the image
+template<typename ImageType>
+class ImageOwnExpr : public ImageExpr<ImageOwnExpr<ImageType>> {
+    std::shared_ptr<const ImageType> image;
+
+public:
+    typedef typename ImageType::sample_type value_type;
+
+    ImageOwnExpr(ImageType&& image) :
+        image(std::make_shared<const ImageType>(std::move(image))) {}
+
+    ivec2 size() const { return image->size(); }
+    image_reference<ImageType> at(ivec2 i) const {
+        return image->at_unsafe(i);
+    }
+};
+
+// views are small, so copied into the expression
+template<typename T>
+class ImageViewExpr : public ImageExpr<ImageViewExpr<T>> {
+    ImageView<const T> view;
+
+public:
+    typedef typename ImageView<const T>::sample_type value_type;
+
+    ImageViewExpr(ImageView<const T> view) : view(view) {}
+
+    ivec2 size() const { return view.size(); }
+    image_reference<ImageView<const T>> at(ivec2 i) const {
+        return view.at_unsafe(i);
+    }
+};
+
+template<typename Expr, typename Func>
+class ApplyExpr : public ImageExpr<ApplyExpr<Expr, Func>> {
+    Expr e;
+    Func f;
+
+public:
+    typedef std::decay_t<decltype(
+        std::declval<const Func&>()(
+            std::declval<const Expr&>().at(ivec2())))> value_type;
+
+    ApplyExpr(const Expr& e, const Func& f) : e(e), f(f) {}
+
+    ivec2 size() const { return e.size(); }
+    value_type at(ivec2 i) const { return f(e.at(i)); }
+};
+
+template<typename Op, typename A, typename B>
+class BinaryExpr : public ImageExpr<BinaryExpr<Op, A, B>> {
+    A a;
+    B b;
+
+public:
+    typedef std::decay_t<decltype(
+        Op()(std::declval<const A&>().at(ivec2()),
+             std::declval<const B&>().at(ivec2())))> value_type;
+
+    BinaryExpr(const A& a, const B& b) : a(a), b(b) {
+        if (a.size() != b.size())
+            throw std::invalid_argument("Image sizes differ");
+    }
+
+    ivec2 size() const { return a.size(); }
+    value_type at(ivec2 i) const { return Op()(a.at(i), b.at(i)); }
+};
+
+template<typename T>
+struct is_image : std::false_type {};
+
+template<typename Color, typename Layout>
+struct is_image<Image<Color, Layout>> : std::true_type {};
+
+template<typename T>
+struct is_image<ImageView<T>> : std::true_type {};
+
+// Image or ImageExpr, after removing references
+template<typename T, typename U = std::decay_t<T>>
+using is_image_operand = std::integral_constant<bool,
+    is_image<U>::value || std::is_base_of<ImageExpr<U>, U>::value>;
+
+template<typename Color, typename Layout>
+auto as_expr(const Image<Color, Layout>& image) { return image.expr(); }
+
+template<typename Color, typename Layout>
+auto as_expr(Image<Color, Layout>&& image) {
+    return std::move(image).expr();
+}
+
+template<typename T>
+auto as_expr(ImageView<T> view) { return view.expr(); }
+
+template<typename Expr>
+const Expr& as_expr(const ImageExpr<Expr>& e) { return e.expr(); }
+
+template<typename Op, typename A, typename B>
+auto
+make_binary_expr(const A& a, const B& b)
+{
+    return BinaryExpr<Op, A, B>(a, b);
+}
+
+#define PGAMECC_IMAGE_OPERATOR(name, op)                                    \
+    struct name {                                                           \
+        template<typename A, typename B>                                    \
+        auto operator()(const A& a, const B& b) const { return a op b; }    \
     };
 
-    class LinearSampler : SamplerBase {
-        using SamplerBase::sample;
+PGAMECC_IMAGE_OPERATOR(image_plus, +)
+PGAMECC_IMAGE_OPERATOR(image_minus, -)
+PGAMECC_IMAGE_OPERATOR(image_multiplies, *)
+PGAMECC_IMAGE_OPERATOR(image_divides, /)
 
-    public:
-        LinearSampler(const Image& image) : SamplerBase{image} {}
+#undef PGAMECC_IMAGE_OPERATOR
 
-        Color operator()(dvec2 p) const {
-            auto f = p * dvec2(LinearSampler::image._size) - .5;
-            auto i = ivec2(glm::floor(f));
-            f -= i;
+}
 
-            // fast shortcut for common case
-            if (f == dvec2(0, 0))
-                return sample(i);
+template<typename Color, typename Layout>
+auto Image<Color, Layout>::expr() const& {
+    return detail::ImageRefExpr<Image>(*this);
+}
 
-            auto v0 = (1-f.x) * sample(i) + f.x * sample(i+ivec2(1, 0));
-            auto v1 = (1-f.x) * sample(i+ivec2(0, 1)) + f.x * sample(i+1);
-            return (1-f.y) * v0 + f.y * v1;
+template<typename Color, typename Layout>
+auto Image<Color, Layout>::expr() && {
+    return detail::ImageOwnExpr<Image>(std::move(*this));
+}
+
+template<typename T>
+auto ImageView<T>::expr() const {
+    return detail::ImageViewExpr<std::remove_const_t<T>>(*this);
+}
+
+template<typename Expr>
+template<typename Func>
+auto
+ImageExpr<Expr>::apply(const Func& f) const
+{
+    return detail::ApplyExpr<Expr, Func>(expr(), f);
+}
+
+// Pixelwise arithmetic between images or expressions of the same size, or
+// with a single value applied to all pixels.
+
+#define PGAMECC_IMAGE_OPERATOR(op, name)                                    \
+    template<typename A, typename B, typename = std::enable_if_t<          \
+        detail::is_image_operand<A>::value &&                               \
+        detail::is_image_operand<B>::value>>                                \
+    auto operator op(A&& a, B&& b) {                                        \
+        auto ea = detail::as_expr(std::forward<A>(a));                      \
+        auto eb = detail::as_expr(std::forward<B>(b));                      \
+        return detail::make_binary_expr<detail::name>(ea, eb);              \
+    }                                                                       \
+                                                                            \
+    template<typename A, typename B, typename = std::enable_if_t<          \
+        detail::is_image_operand<A>::value &&                               \
+        !detail::is_image_operand<B>::value>, typename = void>              \
+    auto operator op(A&& a, const B& b) {                                   \
+        return detail::as_expr(std::forward<A>(a)).apply(                   \
+            [b](const auto& v) { return v op b; });                         \
+    }                                                                       \
+                                                                            \
+    template<typename A, typename B, typename = std::enable_if_t<          \
+        !detail::is_image_operand<A>::value &&                              \
+        detail::is_image_operand<B>::value>, typename = void,               \
+        typename = void>                                                    \
+    auto operator op(const A& a, B&& b) {                                   \
+        return detail::as_expr(std::forward<B>(b)).apply(                   \
+            [a](const auto& v) { return a op v; });                         \
+    }
+
+PGAMECC_IMAGE_OPERATOR(+, image_plus)
+PGAMECC_IMAGE_OPERATOR(-, image_minus)
+PGAMECC_IMAGE_OPERATOR(*, image_multiplies)
+PGAMECC_IMAGE_OPERATOR(/, image_divides)
+
+#undef PGAMECC_IMAGE_OPERATOR
+
+namespace detail {
+
+// adapts a function of pixel centers to the per-row form of Image constructor
+template<typename Color, typename Func>
+auto
+batch_rows(ivec2 size, const Func& f)
+{
+    return [&f, size](ivec2 start, span<Color> row) {
+        dvec2 p[batch_width];
+        for (size_t x0 = 0; x0 < row.size(); x0 += batch_width) {
+            size_t n = std::min(row.size() - x0, (size_t)batch_width);
+            for (size_t x = 0; x < n; x++)
+                p[x] = pixel_center(
+                    ivec2(start.x + int(x0 + x), start.y), size);
+            f(span<const dvec2>(p, n), row.subspan(x0, n));
         }
     };
+}
 
-public:
-    LinearSampler linear() const { return LinearSampler{*this}; }
+template<typename Color, typename Func, typename... Mode>
+Image<Color>
+make_image_typed(ivec2 size, const Func& f, std::true_type, Mode... mode)
+{
+    return { size, batch_rows<Color>(size, f), mode... };
+}
+
+template<typename Color, typename Func, typename... Mode>
+Image<Color>
+make_image_typed(ivec2 size, const Func& f, std::false_type, Mode... mode)
+{
+    return { size, [&](ivec2 i) { return f(pixel_center(i, size)); },
+             mode... };
+}
+
+}
+
+// Gradient sampled at resolution evenly spaced points from its first to its
+// last stop, evaluated by linear interpolation between neighboring samples.
+// Stops falling between samples get their corners rounded off, by at most
+// one sample spacing; values outside the stops are clamped as in Gradient.
+template<typename Color>
+class BakedGradient {
+    double lo, scale;
+    int last; // resolution - 1
+    std::vector<Color> table; // with the last sample repeated
+
+    friend class Gradient<Color>;
+
+    BakedGradient(double lo, double hi, std::vector<Color> samples) :
+        lo(lo), scale(hi > lo ? (samples.size() - 1) / (hi - lo) : 0),
+        last(samples.size() - 1), table(std::move(samples))
+    {
+        table.push_back(table.back());
+    }
 
 public:
-    template<typename Func>
-    auto apply(const Func& f) {
-        return detail::make_image_sized(
-            _size,
-            [&](ivec2 i) { return f((*this)[i]); });
+    int resolution() const { return last + 1; }
+
+    Color operator()(double v) const {
+        // also maps NaN to the first sample
+        double t = (v - lo) * scale;
+        t = t > 0 ? t < last ? t : last : 0;
+        int i = t;
+        double a = t - i;
+        return table[i] * (1-a) + table[i+1] * a;
+    }
+
+    // out[k] = (*this)(v[k]), in a loop without calls or branches
+    void evaluate(span<const double> v, span<Color> out) const {
+        size_t n = std::min(v.size(), out.size());
+        const Color* p = table.data();
+        for (size_t k = 0; k < n; k++) {
+            double t = (v[k] - lo) * scale;
+            t = t > 0 ? t < last ? t : last : 0;
+            int i = t;
+            double a = t - i;
+            out[k] = p[i] * (1-a) + p[i+1] * a;
+        }
+    }
+
+    // The samples as a resolution x 1 image, e.g. for Texture::load() with
+    // clamp_to_edge(). In a shader, sample the texture at
+    // (v * texture_mapping().x + texture_mapping().y, .5).
+    Image<Color> image() const {
+        return { ivec2(resolution(), 1),
+                 [&](ivec2 i) { return table[i.x]; } };
+    }
+
+    // scale and offset from values to texture coordinates at sample centers
+    dvec2 texture_mapping() const {
+        double s = scale / resolution();
+        return { s, (.5 - lo * scale) / resolution() };
     }
 };
 
+template<typename Color>
+BakedGradient<Color>
+Gradient<Color>::bake(int resolution) const
+{
+    if (resolution < 2)
+        throw std::invalid_argument("Gradient::bake(): resolution below 2");
+    double lo = points.empty() ? 0 : points.begin()->first;
+    double hi = points.empty() ? 1 : points.rbegin()->first;
+    std::vector<Color> samples(resolution);
+    for (int i = 0; i < resolution; i++)
+        samples[i] = (*this)(lo + (hi - lo) * i / (resolution - 1));
+    return { lo, hi, std::move(samples) };
+}
+
+
+// Samples f at pixel centers in [0, 1] coordinates. The pixel type is deduced
+// from the return type of f(dvec2).
 template<typename Func>
 auto
 make_image(ivec2 size, const Func& f) {
     return detail::make_image_sized(
         size,
-        [&](ivec2 i) { return f((dvec2(i)+.5)/dvec2(size)); });
+        [&](ivec2 i) { return f(detail::pixel_center(i, size)); });
+}
+
+// same as make_image, but f is called concurrently from several threads
+template<typename Func>
+auto
+make_image_parallel(ivec2 size, const Func& f, int threads = 0) {
+    return detail::make_image_sized(
+        size,
+        [&](ivec2 i) { return f(detail::pixel_center(i, size)); },
+        Parallel{threads});
+}
+
+// With an explicit pixel type, f may also be a batch function
+// f(span<const dvec2> p, span<Color> out) that fills out[k] from p[k] for
+// blocks of up to detail::batch_width pixels along a row. Functions that only
+// take a single dvec2 are called per pixel.
+template<typename Color, typename Func>
+Image<Color>
+make_image(ivec2 size, const Func& f) {
+    return detail::make_image_typed<Color>(size, f,
+        detail::is_callable<Func, void(span<const dvec2>, span<Color>)>{});
+}
+
+template<typename Color, typename Func>
+Image<Color>
+make_image_parallel(ivec2 size, const Func& f, int threads = 0) {
+    return detail::make_image_typed<Color>(size, f,
+        detail::is_callable<Func, void(span<const dvec2>, span<Color>)>{},
+        Parallel{threads});
 }
 
 }
@@ -0,0 +1,72 @@
+#include "pixel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+using std::invalid_argument;
+
+using namespace pgamecc;
+
+
+static double
+srgb8_code(double v)
+{
+    return color::RGB::gray(v).srgb().r * 255;
+}
+
+// Each segment covers the floats with the same exponent and top 3 mantissa
+// bits, from 2^-13 up to 1. The chord through the ends of a segment lies
+// below the curve, so it is raised by half of the largest gap.
+static detail::SRGB8Tables
+make_srgb8_tables()
+{
+    detail::SRGB8Tables tables;
+    for (int i = 0; i < 104; i++) {
+        uint32_t u0 = 0x39000000 + (i << 20), u1 = u0 + (1 << 20);
+        float x0, x1;
+        std::memcpy(&x0, &u0, sizeof x0);
+        std::memcpy(&x1, &u1, sizeof x1);
+        double y0 = srgb8_code(x0), y1 = srgb8_code(x1);
+
+        double gap = 0;
+        for (int k = 0; k <= 4096; k++)
+            gap = std::max(gap, srgb8_code(x0 + (x1 - x0) * k / 4096) -
+                                (y0 + (y1 - y0) * k / 4096));
+        uint32_t bias = std::lround((y0 + gap / 2 + .5) * 128);
+        uint32_t scale = std::lround((y1 - y0) / 256 * 65536);
+        tables.encode[i] = bias << 16 | scale;
+    }
+    for (int i = 0; i < 256; i++)
+        tables.decode[i] = color::sRGB{ i / 255., 0, 0 }.rgb().r;
+    return tables;
+}
+
+const detail::SRGB8Tables detail::srgb8_tables = make_srgb8_tables();
+
+
+void
+pgamecc::encode_srgb8(span<const color::RGB> in, span<SRGB8_ALPHA8> out)
+{
+    if (in.size() != out.size())
+        throw invalid_argument("encode_srgb8(): sizes differ");
+    for (size_t i = 0; i < in.size(); i++) {
+        out[i].r.bits = srgb8::encode(in[i].r);
+        out[i].g.bits = srgb8::encode(in[i].g);
+        out[i].b.bits = srgb8::encode(in[i].b);
+        out[i].a.bits = 255;
+    }
+}
+
+void
+pgamecc::decode_srgb8(span<const SRGB8_ALPHA8> in, span<color::RGB> out)
+{
+    if (in.size() != out.size())
+        throw invalid_argument("decode_srgb8(): sizes differ");
+    for (size_t i = 0; i < in.size(); i++)
+        out[i] = { srgb8::decode(in[i].r.bits),
+                   srgb8::decode(in[i].g.bits),
+                   srgb8::decode(in[i].b.bits) };
+}
@@ -0,0 +1,188 @@
+#ifndef PGAMECC_PIXEL_H
+#define PGAMECC_PIXEL_H
+
+#include <pgamecc/color.h>
+#include <pgamecc/image.h>
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace pgamecc {
+
+// Compact pixel storage. Image<PackedRGB<Channel>> stores each channel in the
+// given type instead of a double, converting color::RGB values as they are
+// written. Samplers, filters and expressions read pixels back as color::RGB.
+
+// IEEE 754 half precision float, converted with round to nearest even
+struct half {
+    uint16_t bits;
+
+    half() = default;
+    half(float v) : bits(from_float(v)) {}
+    operator float() const { return to_float(bits); }
+
+    static uint16_t from_float(float v) {
+        uint32_t x;
+        std::memcpy(&x, &v, sizeof x);
+        uint32_t sign = x >> 16 & 0x8000;
+        uint32_t abs = x & 0x7fffffff;
+
+        if (abs >= 0x7f800000) // infinity, NaN stays quiet NaN
+            return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+        if (abs >= 0x477ff000) // rounds past 65504
+            return sign | 0x7c00;
+        if (abs < 0x38800000) {
+            // subnormal in half, in units of 2^-24
+            if (abs <= 0x33000000) // up to 2^-25 rounds to 0
+                return sign;
+            uint32_t m = (abs & 0x7fffff) | 0x800000;
+            int shift = 126 - (abs >> 23);
+            uint32_t r = m >> shift, rest = m & ((1u << shift) - 1);
+            uint32_t tie = 1u << (shift-1);
+            return sign | (r + (rest > tie || (rest == tie && r & 1)));
+        }
+        // rebias exponent from 127 to 15, mantissa carry may bump exponent
+        uint32_t r = abs - 0x38000000;
+        return sign | (r + 0xfff + (r >> 13 & 1)) >> 13;
+    }
+
+    static float to_float(uint16_t h) {
+        uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+        uint32_t e = h >> 10 & 0x1f, m = h & 0x3ff;
+        uint32_t x;
+        if (e == 0x1f)
+            x = sign | 0x7f800000 | m << 13;
+        else if (e)
+            x = sign | (e + 112) << 23 | m << 13;
+        else {
+            float v = m * (1.f / (1 << 24)); // subnormal or zero
+            return sign ? -v : v;
+        }
+        float v;
+        std::memcpy(&v, &x, sizeof v);
+        return v;
+    }
+};
+
+// unsigned integer holding [0, 1] as [0, max], values outside are clamped
+template<typename Int>
+struct unorm {
+    static constexpr double max = std::numeric_limits<Int>::max();
+
+    Int bits;
+
+    unorm() = default;
+    unorm(double v) : bits(v > 0 ? v < 1 ? Int(v * max + .5) : Int(max) : 0) {}
+    operator double() const { return bits * (1 / max); }
+};
+
+template<typename Int>
+constexpr double unorm<Int>::max;
+
+typedef unorm<uint8_t> unorm8;
+typedef unorm<uint16_t> unorm16;
+
+namespace detail {
+
+// filled in pixel.cc
+struct SRGB8Tables {
+    uint32_t encode[104]; // linear segments, see srgb8::encode()
+    double decode[256];
+};
+extern const SRGB8Tables srgb8_tables;
+
+}
+
+// 8-bit sRGB code of a linear value in [0, 1], as in GL_SRGB8 textures.
+// Values outside are clamped, NaN encodes as 0.
+//
+// Encoding interpolates linearly within 104 ranges of the float exponent and
+// top mantissa bits. The code it returns is at most 0.56 from the exact,
+// unrounded code, so it is never more than 1 away from the correctly rounded
+// code. Decoding looks up the exact value in a 256-entry table.
+struct srgb8 {
+    uint8_t bits;
+
+    srgb8() = default;
+    srgb8(double v) : bits(encode(v)) {}
+    operator double() const { return decode(bits); }
+
+    static uint8_t encode(double v) {
+        const uint32_t lo_bits = 0x39000000; // 2^-13, encodes as 0
+        const float lo = 1.f / (1 << 13), hi = 1 - 1.f / (1 << 24);
+        float f = float(v);
+        f = f > lo ? f < hi ? f : hi : lo;
+        uint32_t u;
+        std::memcpy(&u, &f, sizeof u);
+        // segment in 8.16 fixed point, bias stored in units of 2^-7
+        uint32_t segment = detail::srgb8_tables.encode[(u - lo_bits) >> 20];
+        uint32_t bias = segment >> 16 << 9, scale = segment & 0xffff;
+        uint32_t t = u >> 12 & 0xff;
+        return (bias + scale * t) >> 16;
+    }
+    static double decode(uint8_t bits) {
+        return detail::srgb8_tables.decode[bits];
+    }
+};
+
+template<typename Channel>
+struct PackedRGB {
+    Channel r, g, b;
+
+    PackedRGB() = default;
+    PackedRGB(color::RGB _) : r(_.r), g(_.g), b(_.b) {}
+    operator color::RGB() const { return { double(r), double(g), double(b) }; }
+};
+
+// named after the matching OpenGL internal formats
+typedef PackedRGB<float>   RGB32F;
+typedef PackedRGB<half>    RGB16F;
+typedef PackedRGB<unorm16> RGB16;
+typedef PackedRGB<unorm8>  RGB8;
+typedef PackedRGB<srgb8>   SRGB8;
+
+template<typename Channel>
+struct sample_type<PackedRGB<Channel>> { typedef color::RGB type; };
+
+// sRGB color with linear alpha, 4 bytes as in GL_SRGB8_ALPHA8 textures.
+// Samplers, filters and expressions see only the color.
+struct SRGB8_ALPHA8 {
+    srgb8 r, g, b;
+    unorm8 a;
+
+    SRGB8_ALPHA8() = default;
+    SRGB8_ALPHA8(color::RGB _, double alpha = 1) :
+        r(_.r), g(_.g), b(_.b), a(alpha) {}
+    operator color::RGB() const { return { double(r), double(g), double(b) }; }
+};
+
+template<>
+struct sample_type<SRGB8_ALPHA8> { typedef color::RGB type; };
+
+// Whole arrays and images at once, with opaque alpha. Array versions throw
+// std::invalid_argument if in and out differ in size.
+void encode_srgb8(span<const color::RGB> in, span<SRGB8_ALPHA8> out);
+void decode_srgb8(span<const SRGB8_ALPHA8> in, span<color::RGB> out);
+
+template<typename... Mode>
+Image<SRGB8_ALPHA8>
+encode_srgb8(const Image<color::RGB>& image, Mode... mode)
+{
+    return { image.size(), [&](ivec2 start, span<SRGB8_ALPHA8> row) {
+        encode_srgb8(image.row(start.y), row);
+    }, mode... };
+}
+
+template<typename... Mode>
+Image<color::RGB>
+decode_srgb8(const Image<SRGB8_ALPHA8>& image, Mode... mode)
+{
+    return { image.size(), [&](ivec2 start, span<color::RGB> row) {
+        decode_srgb8(image.row(start.y), row);
+    }, mode... };
+}
+
+}
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef PGAMECC_RESAMPLE_H
+#define PGAMECC_RESAMPLE_H
+
+#include <pgamecc/image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace pgamecc {
+
+// Separable resampling filters. Pixels outside the image are clamped to the
+// nearest edge pixel, same as LinearSampler. Sums are computed in the
+// sample_type of Color, which needs a zero default value, addition and
+// multiplication by double.
+enum class Filter {
+    box,      // average of covered source pixels
+    bilinear, // tent, same as LinearSampler when magnifying
+    lanczos   // windowed sinc with 3 lobes, sharper but may ring
+};
+
+namespace detail {
+
+inline double
+filter_support(Filter filter)
+{
+    switch (filter) {
+    case Filter::box:      return .5;
+    case Filter::bilinear: return 1;
+    case Filter::lanczos:  return 3;
+    }
+    return 0;
+}
+
+inline double
+filter_weight(Filter filter, double x)
+{
+    x = std::fabs(x);
+    switch (filter) {
+    case Filter::box:
+        return x < .5 ? 1 : x == .5 ? .5 : 0;
+    case Filter::bilinear:
+        return std::max(0., 1 - x);
+    case Filter::lanczos: {
+        if (x >= 3)
+            return 0;
+        if (x < 1e-8)
+            return 1;
+        const double pi = 3.14159265358979323846;
+        return 3 * std::sin(pi * x) * std::sin(pi * x / 3) / (pi * pi * x * x);
+    }
+    }
+    return 0;
+}
+
+// Weights of source pixels for each destination pixel along one axis. Every
+// destination pixel uses the same number of taps starting at first[i], so the
+// inner loops have a fixed length; edge clamping is folded into the weights.
+struct ResampleTaps {
+    int taps;
+    std::vector<int> first;
+    std::vector<double> weights; // taps per destination pixel
+
+    ResampleTaps(int from, int to, Filter filter) {
+        double scale = (double)from / to;
+        double width = std::max(scale, 1.); // widen kernel when minifying
+        double support = filter_support(filter) * width;
+        taps = std::min(from, (int)std::ceil(support * 2) + 1);
+
+        first.resize(to);
+        weights.assign((size_t)to * taps, 0);
+        for (int i = 0; i < to; i++) {
+            double center = (i + .5) * scale - .5;
+            int lo = (int)std::floor(center - support);
+            int hi = (int)std::ceil(center + support);
+            int start = std::max(0, std::min(lo, from - taps));
+            double* w = &weights[(size_t)i * taps];
+            double sum = 0;
+            for (int j = lo; j <= hi; j++) {
+                double v = filter_weight(filter, (j - center) / width);
+                if (v == 0)
+                    continue;
+                w[std::max(0, std::min(j, from - 1)) - start] += v;
+                sum += v;
+            }
+            // box filter may fall between pixels when magnifying
+            if (sum == 0) {
+                w[std::max(0, std::min((int)std::lround(center), from - 1)) -
+                  start] = sum = 1;
+            }
+            for (int k = 0; k < taps; k++)
+                w[k] /= sum;
+            first[i] = start;
+        }
+    }
+};
+
+template<typename Color>
+Image<Color>
+resample_rows(const Image<Color>& image, int width, Filter filter)
+{
+    typedef sample_type_t<Color> Sample;
+    ResampleTaps t(image.size().x, width, filter);
+    Image<Color> result(ivec2(width, image.size().y));
+    for (int y = 0; y < image.size().y; y++) {
+        const Color* in = image.row(y).data();
+        Color* out = result.row(y).data();
+        for (int x = 0; x < width; x++) {
+            const Color* p = in + t.first[x];
+            const double* w = &t.weights[(size_t)x * t.taps];
+            Sample sum = Sample();
+            for (int k = 0; k < t.taps; k++)
+                sum = sum + w[k] * Sample(p[k]);
+            out[x] = sum;
+        }
+    }
+    return result;
+}
+
+template<typename Color>
+Image<Color>
+resample_columns(const Image<Color>& image, int height, Filter filter)
+{
+    typedef sample_type_t<Color> Sample;
+    ResampleTaps t(image.size().y, height, filter);
+    int width = image.size().x;
+    Image<Color> result(ivec2(width, height));
+    std::vector<Sample> sum(width);
+    for (int y = 0; y < height; y++) {
+        // accumulate whole source rows so the inner loop is contiguous
+        const double* w = &t.weights[(size_t)y * t.taps];
+        for (int k = 0; k < t.taps; k++) {
+            const Color* in = image.row(t.first[y] + k).data();
+            double wk = w[k];
+            if (k == 0)
+                for (int x = 0; x < width; x++)
+                    sum[x] = wk * Sample(in[x]);
+            else
+                for (int x = 0; x < width; x++)
+                    sum[x] = sum[x] + wk * Sample(in[x]);
+        }
+        std::copy(sum.begin(), sum.end(), result.row(y).begin());
+    }
+    return result;
+}
+
+// average 2x2 source blocks into one destination row; odd trailing source
+// rows and columns are dropped, as with OpenGL mipmap sizes
+template<typename Color>
+void
+reduce_rows(const Color* a, const Color* b, int from, Color* out, int to)
+{
+    typedef sample_type_t<Color> S;
+    if (from == 1)
+        for (int x = 0; x < to; x++)
+            out[x] = .5 * (S(a[0]) + S(b[0]));
+    else
+        for (int x = 0; x < to; x++)
+            out[x] = .25 * (S(a[2*x]) + S(a[2*x+1]) +
+                            S(b[2*x]) + S(b[2*x+1]));
+}
+
+}
+
+// resample image to a new size with a separable filter
+template<typename Color>
+Image<Color>
+resample(const Image<Color>& image, ivec2 size,
+         Filter filter = Filter::bilinear)
+{
+    if (size.x <= 0 || size.y <= 0 || image.size().x <= 0 ||
+            image.size().y <= 0)
+        throw std::invalid_argument("resample(): empty Image");
+    // reduce first along the axis that shrinks more, to do less work
+    if ((double)size.x / image.size().x <= (double)size.y / image.size().y)
+        return detail::resample_columns(
+            detail::resample_rows(image, size.x, filter), size.y, filter);
+    else
+        return detail::resample_rows(
+            detail::resample_columns(image, size.y, filter), size.x, filter);
+}
+
+// Builds all mipmap levels down to 1x1, with level 0 being the image itself.
+// Each level halves the previous one (rounding down) with a 2x2 box filter.
+// Rows of all levels are produced while the source rows are still in cache.
+template<typename Color>
+std::vector<Image<Color>>
+mip_pyramid(Image<Color> image)
+{
+    std::vector<Image<Color>> levels;
+    ivec2 size = image.size();
+    if (size.x <= 0 || size.y <= 0)
+        throw std::invalid_argument("mip_pyramid(): empty Image");
+    levels.push_back(std::move(image));
+    while (size != ivec2(1, 1)) {
+        size = glm::max(size / 2, ivec2(1));
+        levels.emplace_back(size);
+    }
+
+    // when row y of a level is complete, complete the next level's row if
+    // both its source rows are available
+    for (int y0 = 0; y0 < levels[0].size().y; y0++)
+        for (size_t l = 0, y = y0; l + 1 < levels.size(); l++, y /= 2) {
+            auto& src = levels[l];
+            auto& dst = levels[l+1];
+            int h = src.size().y;
+            if (!(y % 2 || (int)y == h-1) || (int)y/2 >= dst.size().y)
+                break;
+            detail::reduce_rows(src.row(y & ~1).data(),
+                                src.row(std::min((int)y | 1, h-1)).data(),
+                                src.size().x,
+                                dst.row(y/2).data(), dst.size().x);
+        }
+
+    return levels;
+}
+
+}
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef PGAMECC_SAMPLER_H
+#define PGAMECC_SAMPLER_H
+
+#include <pgamecc/types.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace pgamecc {
+
+// Samplers read an image at continuous [0, 1] coordinates, with pixel
+// centers at (i + .5) / size as in make_image(). Pixels outside the image are
+// clamped to the nearest edge pixel.
+//
+// A sampler works on any Source with size(), at_unsafe(ivec2) and a
+// sample_type, which is what it returns. It keeps a reference to an Image,
+// which must outlive it, and a copy of an ImageView.
+//
+// Besides single points, samplers take batches of points, which also makes
+// them batch functions for make_image<Color>(), and regular grids, where the
+// weights along each axis are computed once per column and once per row.
+
+namespace detail {
+
+// Separable filter kernels. weights(t, w) fills taps weights for the pixels
+// starting at the returned index, where t is in pixels relative to centers.
+
+struct NearestKernel {
+    static constexpr int taps = 1;
+
+    static int weights(double t, double* w) {
+        w[0] = 1;
+        return (int)std::floor(t + .5);
+    }
+};
+
+struct LinearKernel {
+    static constexpr int taps = 2;
+
+    static int weights(double t, double* w) {
+        double i = std::floor(t), f = t - i;
+        w[0] = 1 - f;
+        w[1] = f;
+        return i;
+    }
+};
+
+// Catmull-Rom spline, passes through pixel values but may overshoot them
+struct CubicKernel {
+    static constexpr int taps = 4;
+
+    static int weights(double t, double* w) {
+        double i = std::floor(t), f = t - i, f2 = f*f, f3 = f2*f;
+        w[0] = .5 * (-f3 + 2*f2 - f);
+        w[1] = .5 * (3*f3 - 5*f2 + 2);
+        w[2] = .5 * (-3*f3 + 4*f2 + f);
+        w[3] = .5 * (f3 - f2);
+        return i - 1;
+    }
+};
+
+// pixels and weights along one axis, with clamping folded into the indices
+template<int N>
+struct SampleTaps {
+    int i[N];
+    double w[N];
+};
+
+// how a sampler holds its source, specialized for cheap to copy sources
+template<typename Source>
+struct sampler_source { typedef const Source& type; };
+
+}
+
+template<typename Source, typename Kernel>
+class FilterSampler {
+    static constexpr int N = Kernel::taps;
+    typedef detail::SampleTaps<N> Taps;
+
+    typename detail::sampler_source<Source>::type source;
+
+public:
+    typedef typename Source::sample_type sample_type;
+
+    explicit FilterSampler(const Source& source) : source(source) {}
+
+    sample_type operator()(dvec2 p) const {
+        ivec2 size = source.size();
+        dvec2 t = p * dvec2(size) - .5;
+        return combine(taps(t.x, size.x), taps(t.y, size.y));
+    }
+
+    // out[k] = (*this)(p[k])
+    void operator()(span<const dvec2> p, span<sample_type> out) const {
+        if (p.size() != out.size())
+            throw std::invalid_argument("FilterSampler: batch sizes differ");
+        ivec2 size = source.size();
+        dvec2 scale(size);
+        for (size_t k = 0; k < p.size(); k++) {
+            dvec2 t = p[k] * scale - .5;
+            out[k] = combine(taps(t.x, size.x), taps(t.y, size.y));
+        }
+    }
+
+    // Samples count.x by count.y points origin + step * ivec2(x, y) into out
+    // row by row, e.g. a pixel-aligned warp or a zoomed view.
+    void grid(dvec2 origin, dvec2 step, ivec2 count,
+              span<sample_type> out) const {
+        if (count.x < 0 || count.y < 0 ||
+                out.size() != (size_t)count.x * count.y)
+            throw std::invalid_argument("FilterSampler::grid(): bad count");
+        ivec2 size = source.size();
+        std::vector<Taps> columns(count.x);
+        for (int x = 0; x < count.x; x++)
+            columns[x] = taps((origin.x + step.x * x) * size.x - .5, size.x);
+        sample_type* o = out.data();
+        for (int y = 0; y < count.y; y++) {
+            Taps row = taps((origin.y + step.y * y) * size.y - .5, size.y);
+            for (int x = 0; x < count.x; x++)
+                *o++ = combine(columns[x], row);
+        }
+    }
+
+private:
+    // interior pixels are read directly, only taps past the border clamp
+    static Taps taps(double t, int n) {
+        Taps a;
+        int first = Kernel::weights(t, a.w);
+        if (first >= 0 && first + N <= n)
+            for (int k = 0; k < N; k++)
+                a.i[k] = first + k;
+        else
+            for (int k = 0; k < N; k++)
+                a.i[k] = std::max(0, std::min(first + k, n-1));
+        return a;
+    }
+
+    sample_type combine(const Taps& x, const Taps& y) const {
+        return combine(x, y, std::integral_constant<bool, N == 1>{});
+    }
+
+    // single tap needs no arithmetic on sample_type
+    sample_type combine(const Taps& x, const Taps& y, std::true_type) const {
+        return source.at_unsafe(ivec2(x.i[0], y.i[0]));
+    }
+
+    sample_type combine(const Taps& x, const Taps& y, std::false_type) const {
+        sample_type sum = sample_type();
+        for (int b = 0; b < N; b++) {
+            sample_type row = sample_type();
+            for (int a = 0; a < N; a++)
+                row = row + x.w[a] * sample_type(
+                    source.at_unsafe(ivec2(x.i[a], y.i[b])));
+            sum = sum + y.w[b] * row;
+        }
+        return sum;
+    }
+};
+
+template<typename Source>
+using NearestSampler = FilterSampler<Source, detail::NearestKernel>;
+
+template<typename Source>
+using LinearSampler = FilterSampler<Source, detail::LinearKernel>;
+
+template<typename Source>
+using CubicSampler = FilterSampler<Source, detail::CubicKernel>;
+
+}
+
+#endif
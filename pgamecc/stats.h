@@ -0,0 +1,238 @@
+#ifndef PGAMECC_STATS_H
+#define PGAMECC_STATS_H
+
+#include <pgamecc/color.h>
+#include <pgamecc/image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace pgamecc {
+
+namespace detail {
+
+// per-channel square, for variances
+inline double stat_square(double v) { return v * v; }
+inline color::RGB stat_square(color::RGB c) {
+    return { c.r * c.r, c.g * c.g, c.b * c.b };
+}
+
+}
+
+// Summed-area table of an image, answering sums, means and variances over
+// any rectangle in constant time. Works for pixel types whose sample_type is
+// double or color::RGB, with variances per channel.
+//
+// Sums are taken relative to the first pixel to limit cancellation in the
+// variance, which is still only as precise as the total sum of squares.
+template<typename Color>
+class SummedArea {
+public:
+    typedef sample_type_t<Color> value_type;
+
+private:
+    ivec2 _size;
+    value_type shift;
+    // (width+1) x (height+1), with a zero first row and column
+    std::vector<value_type> sums, squares;
+
+    size_t index(ivec2 i) const { return i.x + (size_t)i.y * (_size.x + 1); }
+
+    template<typename Table>
+    value_type area(const Table& t, irect r) const {
+        return t[index(r.max)] - t[index(ivec2(r.min.x, r.max.y))] -
+               t[index(ivec2(r.max.x, r.min.y))] + t[index(r.min)];
+    }
+
+    void check(irect r) const {
+        if (!irect{ivec2(0), _size}.contains(r))
+            throw std::out_of_range("rectangle outside SummedArea bounds");
+    }
+
+    void build(const Image<Color>& image, int threads) {
+        int w = _size.x, h = _size.y;
+        sums.assign(index(_size) + 1, value_type());
+        squares.assign(sums.size(), value_type());
+        if (!w || !h)
+            return;
+        shift = image.at_unsafe(ivec2(0));
+
+        // prefix sums along rows, independent for each row
+        parallel_bands(h, threads, [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                auto row = image.row(y);
+                value_type* s = &sums[index(ivec2(1, y+1))];
+                value_type* q = &squares[index(ivec2(1, y+1))];
+                value_type sum = value_type(), square = value_type();
+                for (int x = 0; x < w; x++) {
+                    value_type v = value_type(row[x]) - shift;
+                    s[x] = sum = sum + v;
+                    q[x] = square = square + detail::stat_square(v);
+                }
+            }
+        });
+
+        // then down columns, in bands of columns so rows stay contiguous
+        parallel_bands(w, threads, [&](int x0, int x1) {
+            for (int y = 2; y <= h; y++) {
+                value_type* s = &sums[index(ivec2(1, y))];
+                value_type* q = &squares[index(ivec2(1, y))];
+                const value_type* ps = s - (w + 1);
+                const value_type* pq = q - (w + 1);
+                for (int x = x0; x < x1; x++) {
+                    s[x] = s[x] + ps[x];
+                    q[x] = q[x] + pq[x];
+                }
+            }
+        });
+    }
+
+public:
+    explicit SummedArea(const Image<Color>& image) :
+        _size(image.size()), shift()
+    {
+        build(image, 1);
+    }
+
+    SummedArea(const Image<Color>& image, Parallel parallel) :
+        _size(image.size()), shift()
+    {
+        build(image, parallel.threads);
+    }
+
+    ivec2 size() const { return _size; }
+
+    // Throw std::out_of_range for rectangles not inside the image, and mean
+    // and variance throw std::invalid_argument for empty rectangles.
+    value_type sum(irect r) const {
+        check(r);
+        if (r.empty())
+            return value_type();
+        double n = (double)r.size().x * r.size().y;
+        return area(sums, r) + n * shift;
+    }
+
+    value_type mean(irect r) const {
+        check(r);
+        if (r.empty())
+            throw std::invalid_argument("mean of empty rectangle");
+        double n = (double)r.size().x * r.size().y;
+        return area(sums, r) / n + shift;
+    }
+
+    // population variance
+    value_type variance(irect r) const {
+        check(r);
+        if (r.empty())
+            throw std::invalid_argument("variance of empty rectangle");
+        double n = (double)r.size().x * r.size().y;
+        value_type m = area(sums, r) / n;
+        return area(squares, r) / n - detail::stat_square(m);
+    }
+};
+
+
+// Bulk reductions over scalar images, e.g. to normalize noise to [0, 1].
+// NaN pixels are skipped.
+
+namespace detail {
+
+inline std::pair<double, double>
+minmax_rows(const Image<double>& image, int threads)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    int bands = std::max(1, std::min(threads > 0 ? threads : default_threads(),
+                                     image.size().y));
+    std::vector<std::pair<double, double>> partial(bands, { inf, -inf });
+    parallel_bands(bands, threads, [&](int b0, int b1) {
+        for (int b = b0; b < b1; b++) {
+            // comparisons written so that NaN is never picked
+            double lo = inf, hi = -inf;
+            int y0 = (long long)image.size().y * b / bands;
+            int y1 = (long long)image.size().y * (b+1) / bands;
+            for (int y = y0; y < y1; y++)
+                for (double v: image.row(y)) {
+                    lo = v < lo ? v : lo;
+                    hi = v > hi ? v : hi;
+                }
+            partial[b] = { lo, hi };
+        }
+    });
+    std::pair<double, double> result{ inf, -inf };
+    for (auto p: partial) {
+        result.first = std::min(result.first, p.first);
+        result.second = std::max(result.second, p.second);
+    }
+    return result;
+}
+
+inline std::vector<size_t>
+histogram_rows(const Image<double>& image, int bins, double lo, double hi,
+               int threads)
+{
+    if (bins <= 0 || !(hi > lo))
+        throw std::invalid_argument("histogram(): bad bins or range");
+    int bands = std::max(1, std::min(threads > 0 ? threads : default_threads(),
+                                     image.size().y));
+    std::vector<std::vector<size_t>> partial(bands,
+                                             std::vector<size_t>(bins));
+    double scale = bins / (hi - lo);
+    parallel_bands(bands, threads, [&](int b0, int b1) {
+        for (int b = b0; b < b1; b++) {
+            size_t* count = partial[b].data();
+            int y0 = (long long)image.size().y * b / bands;
+            int y1 = (long long)image.size().y * (b+1) / bands;
+            for (int y = y0; y < y1; y++)
+                for (double v: image.row(y)) {
+                    if (v != v)
+                        continue;
+                    double t = (v - lo) * scale;
+                    count[t > 0 ? t < bins ? (int)t : bins-1 : 0]++;
+                }
+        }
+    });
+    std::vector<size_t> result(bins);
+    for (auto& p: partial)
+        for (int i = 0; i < bins; i++)
+            result[i] += p[i];
+    return result;
+}
+
+}
+
+// smallest and largest pixel, or (inf, -inf) if there are none
+inline std::pair<double, double>
+minmax(const Image<double>& image)
+{
+    return detail::minmax_rows(image, 1);
+}
+
+inline std::pair<double, double>
+minmax(const Image<double>& image, Parallel parallel)
+{
+    return detail::minmax_rows(image, parallel.threads);
+}
+
+// Counts of pixels in bins equal parts of [lo, hi). Pixels outside the range
+// are counted in the first or last bin.
+inline std::vector<size_t>
+histogram(const Image<double>& image, int bins, double lo, double hi)
+{
+    return detail::histogram_rows(image, bins, lo, hi, 1);
+}
+
+inline std::vector<size_t>
+histogram(const Image<double>& image, int bins, double lo, double hi,
+          Parallel parallel)
+{
+    return detail::histogram_rows(image, bins, lo, hi, parallel.threads);
+}
+
+}
+
+#endif
@@ -1,8 +1,10 @@
 #ifndef PGAMECC_TYPES_H
 #define PGAMECC_TYPES_H
 
+#include <cstddef>
 #include <iostream>
 #include <type_traits>
+#include <utility>
 
 #define GLM_SWIZZLE
 
@@ -83,6 +85,77 @@ round_down(T n, T d)
 }
 
 
+// view of a contiguous array, like std::span from C++20
+
+template<typename T>
+class span {
+    T* _data;
+    size_t _size;
+
+public:
+    span() : _data(nullptr), _size(0) {}
+    span(T* data, size_t size) : _data(data), _size(size) {}
+
+    template<size_t N>
+    span(T (&data)[N]) : span(data, N) {}
+
+    // std::vector, std::array and the like
+    template<typename Container, typename = std::enable_if_t<
+        std::is_convertible<decltype(std::declval<Container&>().data()),
+                            T*>::value>>
+    span(Container& c) : span(c.data(), c.size()) {}
+
+    // span<T> to span<const T>
+    template<typename U, typename = std::enable_if_t<
+        std::is_convertible<U(*)[], T(*)[]>::value>>
+    span(span<U> s) : span(s.data(), s.size()) {}
+
+    T* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool empty() const { return !_size; }
+
+    T& operator[](size_t i) const { return _data[i]; }
+
+    T* begin() const { return _data; }
+    T* end() const { return _data + _size; }
+
+    span subspan(size_t offset, size_t count) const {
+        return { _data + offset, count };
+    }
+};
+
+
+// rectangle of pixels or tiles from min inclusive to max exclusive
+
+struct irect {
+    ivec2 min, max;
+
+    ivec2 size() const { return max - min; }
+    bool empty() const { return max.x <= min.x || max.y <= min.y; }
+
+    bool contains(ivec2 p) const {
+        return p.x >= min.x && p.y >= min.y && p.x < max.x && p.y < max.y;
+    }
+    bool contains(irect r) const {
+        return r.empty() || r.min.x >= min.x && r.min.y >= min.y &&
+                            r.max.x <= max.x && r.max.y <= max.y;
+    }
+
+    // intersection, may be empty
+    irect operator&(irect r) const {
+        return { glm::max(min, r.min), glm::min(max, r.max) };
+    }
+    // bounding rectangle
+    irect operator|(irect r) const {
+        return empty() ? r : r.empty() ? *this :
+            irect{ glm::min(min, r.min), glm::max(max, r.max) };
+    }
+
+    bool operator==(irect r) const { return min == r.min && max == r.max; }
+    bool operator!=(irect r) const { return !(*this == r); }
+};
+
+
 // for std::set and std::map
 struct ivec2_compare {
     bool operator()(ivec2 a, ivec2 b) const {
@@ -152,6 +225,11 @@ operator<<(std::ostream& os, pgamecc::dvec4 v) {
         "dvec4(" << v.x << ", " << v.y <<  ", " << v.z << ", " << v.w << ')';
 }
 
+inline std::ostream&
+operator<<(std::ostream& os, pgamecc::irect r) {
+    return os << "irect(" << r.min << ", " << r.max << ')';
+}
+
 inline std::ostream&
 operator<<(std::ostream& os, pgamecc::dquat q) {
     // order matches constructor arguments, not struct fields
@@ -29,3 +29,11 @@ Timer::elapsed_us()
 {
     return elapsed() - from;
 }
+
+
+int
+pgamecc::default_threads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
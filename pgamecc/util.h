@@ -1,7 +1,15 @@
 #ifndef PGAMECC_UTIL_H
 #define PGAMECC_UTIL_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
 #include <iostream>
+#include <new>
+#include <thread>
+#include <vector>
 
 namespace pgamecc {
 
@@ -14,6 +22,94 @@ class Timer {
     long long elapsed_ms() { return elapsed_us() / 1000; }
 };
 
+
+// number of worker threads used when a thread count of 0 is requested
+int default_threads();
+
+// Calls f(begin, end) for contiguous bands covering [0, n) on up to threads
+// workers, including the calling thread. Bands are handed out dynamically so
+// uneven work still balances. Exceptions thrown by f are rethrown here after
+// all workers have finished.
+template<typename Func>
+void parallel_bands(int n, int threads, const Func& f)
+{
+    if (threads <= 0)
+        threads = default_threads();
+    threads = std::min(threads, n);
+    if (threads <= 1) {
+        if (n > 0)
+            f(0, n);
+        return;
+    }
+
+    // a few bands per thread so a slow band doesn't stall the others
+    int bands = std::min(n, threads * 4);
+    std::atomic<int> next{0};
+    std::exception_ptr error;
+    std::atomic_flag error_lock = ATOMIC_FLAG_INIT;
+
+    auto work = [&] {
+        for (int b; (b = next++) < bands;)
+            try {
+                f((long long)n * b / bands, (long long)n * (b+1) / bands);
+            } catch (...) {
+                if (!error_lock.test_and_set())
+                    error = std::current_exception();
+                next = bands;
+            }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(work);
+    work();
+    for (auto& w: workers)
+        w.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+
+// Allocator returning memory aligned to Align bytes, by default a cache line,
+// which is also enough for any SIMD loads. The offset to the block returned
+// by operator new is stored in the byte just before the aligned pointer.
+template<typename T, size_t Align = 64>
+struct AlignedAllocator {
+    static_assert(Align >= alignof(T) && Align <= 256 &&
+                  (Align & Align-1) == 0,
+                  "alignment must be a power of two up to 256");
+
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind { typedef AlignedAllocator<U, Align> other; };
+
+    AlignedAllocator() = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+    T* allocate(size_t n) {
+        if (n > ((size_t)-1 - Align) / sizeof(T))
+            throw std::bad_alloc();
+        auto block = static_cast<char*>(::operator new(n*sizeof(T) + Align));
+        size_t shift = Align - (uintptr_t)block % Align; // 1 to Align
+        block[shift - 1] = (unsigned char)(shift - 1);
+        return reinterpret_cast<T*>(block + shift);
+    }
+
+    void deallocate(T* p, size_t) {
+        char* aligned = reinterpret_cast<char*>(p);
+        ::operator delete(aligned - 1 - (unsigned char)aligned[-1]);
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Align>&) const { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Align>&) const { return false; }
+};
+
 }
 
 #endif
@@ -170,6 +170,7 @@ WindowBase::_pgamecc_cycle()
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 #endif
     glfwWindowHint(GLFW_SAMPLES, _pgamecc.samples);
+    glfwWindowHint(GLFW_SRGB_CAPABLE, _pgamecc.srgb);
     GLFWwindow* window = glfwCreateWindow(size().x, size().y,
                                           _pgamecc.title.c_str(),
                                           monitor, NULL);
@@ -196,6 +197,10 @@ WindowBase::_pgamecc_cycle()
     glGenVertexArrays(1, &default_vao);
     glBindVertexArray(default_vao);
 
+    gl::detail::default_framebuffer_srgb = _pgamecc.srgb;
+    if (_pgamecc.srgb)
+        glEnable(GL_FRAMEBUFFER_SRGB);
+
     // TODO: can this fail if the window is iconified?
     // TODO: this can be overridden by the user
     glfwSwapInterval(1); // vsync
@@ -349,6 +354,13 @@ WindowBase::set_samples(int samples)
     _pgamecc.reset = true;
 }
 
+void
+WindowBase::set_srgb(bool srgb)
+{
+    _pgamecc.srgb = srgb;
+    _pgamecc.reset = true;
+}
+
 void
 WindowBase::set_title(const string title)
 {
@@ -125,6 +125,7 @@ class WindowBase {
         bool next_grab = false;
         bool quit = false;
         int samples = 0;
+        bool srgb = false;
         std::string title;
 
         // statistics
@@ -150,12 +151,16 @@ public:
     void quit();
     void fullscreen();
     void set_samples(int samples);
+    // default framebuffer encodes linear output to sRGB, as do framebuffers
+    // with sRGB color attachments regardless of this
+    void set_srgb(bool srgb = true);
     void set_title(const std::string);
     void grab_mouse();
     void release_mouse();
 
     // queries
     ivec2 size() const { return _pgamecc.size[_pgamecc.fullscreen]; }
+    bool srgb() const { return _pgamecc.srgb; }
 
     double fps() const { return _pgamecc.fps; };
     double step_load() const { return _pgamecc.step_load; }
@@ -0,0 +1,121 @@
+#define BOOST_TEST_MODULE cache
+#include <boost/test/included/unit_test.hpp>
+
+#include "image.h"
+
+#include "color.h"
+
+#include <pgamecc/cache.h>
+
+#include <cstdlib>
+#include <string>
+
+using std::runtime_error;
+using std::string;
+
+using namespace pgamecc;
+using namespace pgamecc::color;
+
+
+static string
+temp_dir()
+{
+    char name[] = "/tmp/pgamecc_cache_XXXXXX";
+    BOOST_REQUIRE(mkdtemp(name));
+    return name;
+}
+
+
+//
+// The tests
+//
+
+BOOST_AUTO_TEST_CASE(cache_round_trip)
+{
+    string dir = temp_dir();
+
+    Image<double> a({5, 3}, [](ivec2 i) { return i.x + 10.*i.y; });
+    save_image(a, dir + "/a.img");
+    MappedImage<double> ma(dir + "/a.img");
+    BOOST_CHECK_EQUAL(ma.size().x, a.size().x);
+    BOOST_CHECK_EQUAL(ma.size().y, a.size().y);
+    for (int y = 0; y < 3; y++)
+        for (int x = 0; x < 5; x++) {
+            BOOST_TEST(ma[ivec2(x, y)] == a[ivec2(x, y)]);
+            BOOST_TEST(ma.row(y)[x] == a[ivec2(x, y)]);
+        }
+    BOOST_CHECK_THROW(ma[ivec2(5, 0)], std::out_of_range);
+    Image<double> ca = ma.image();
+    BOOST_CHECK_EQUAL(ca.size().x, a.size().x);
+    BOOST_CHECK_EQUAL(ca.size().y, a.size().y);
+    BOOST_TEST(ca.pixels() == a.pixels(), boost::test_tools::per_element());
+
+    Image<RGB> b({4, 4}, [](ivec2 i) {
+        return RGB{ 1.*i.x, 1.*i.y, 1.*i.x*i.y };
+    });
+    save_image(b, dir + "/b.img");
+    MappedImage<RGB> mb(dir + "/b.img");
+    BOOST_CHECK_EQUAL(mb.size().x, b.size().x);
+    BOOST_CHECK_EQUAL(mb.size().y, b.size().y);
+    for (int y = 0; y < 4; y++)
+        for (int x = 0; x < 4; x++)
+            CHECK_EQ(mb[ivec2(x, y)], b[ivec2(x, y)]);
+    auto view = mb.view();
+    BOOST_TEST(view.data() == mb.pixels().data());
+    CHECK_EQ(view.view(irect{ivec2(1), ivec2(3)})[ivec2(1, 0)],
+             b[ivec2(2, 1)]);
+
+    // wrong pixel type
+    BOOST_CHECK_THROW(MappedImage<float>(dir + "/a.img"), runtime_error);
+    BOOST_CHECK_THROW(MappedImage<RGB>(dir + "/a.img"), runtime_error);
+    BOOST_CHECK_THROW(MappedImage<double>(dir + "/none.img"), runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(cache_key_strings)
+{
+    using detail::hash_key;
+
+    // the same text in different buffers, in every position of the key
+    char a[] = "seed", b[] = "seed";
+    const char* pa = a;
+    const char* pb = b;
+    BOOST_TEST(hash_key(0, pa) == hash_key(0, pb));
+    BOOST_TEST(hash_key(0, 1, pa) == hash_key(0, 1, pb));
+    BOOST_TEST(hash_key(0, 1, pa, 2.) == hash_key(0, 1, pb, 2.));
+    BOOST_TEST(hash_key(0, 1, a) == hash_key(0, 1, b));
+
+    // literals, pointers and strings all hash as the text
+    BOOST_TEST(hash_key(0, 1, "seed") == hash_key(0, 1, pa));
+    BOOST_TEST(hash_key(0, 1, "seed") == hash_key(0, 1, string("seed")));
+    BOOST_TEST(hash_key(0, "seed", 1) == hash_key(0, string("seed"), 1));
+
+    // the lengths keep the parts apart
+    BOOST_TEST(hash_key(0, 1, "ab", "c") != hash_key(0, 1, "a", "bc"));
+    const char* ab = "ab";
+    const char* bc = "bc";
+    BOOST_TEST(hash_key(0, 1, ab, "c") != hash_key(0, 1, "a", bc));
+    BOOST_TEST(hash_key(0, 1, "seed") != hash_key(0, 1, "seeds"));
+}
+
+BOOST_AUTO_TEST_CASE(cache_make_image)
+{
+    ImageCache cache(temp_dir());
+
+    int calls = 0;
+    auto f = [&](dvec2 p) { calls++; return p.x * p.y; };
+
+    auto a = cache.make_image({8, 8}, f, 1, string("seed"));
+    BOOST_TEST(calls == 64);
+    auto b = cache.make_image({8, 8}, f, 1, string("seed"));
+    BOOST_TEST(calls == 64);
+    BOOST_TEST(b.pixels() == a.pixels(), boost::test_tools::per_element());
+
+    cache.make_image({8, 8}, f, 2, string("seed"));
+    BOOST_TEST(calls == 128);
+    cache.make_image({8, 4}, f, 1, string("seed"));
+    BOOST_TEST(calls == 160);
+
+    Image<double> expected = make_image({8, 8}, f);
+    BOOST_TEST(a.pixels() == expected.pixels(),
+               boost::test_tools::per_element());
+}
@@ -3,8 +3,21 @@
 
 #include "color.h"
 
+#include <pgamecc/image.h>
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
 using namespace pgamecc::color;
 
+// bit for bit, except that any NaN equals any other, e.g. the saturation of
+// out-of-gamut colors
+static bool
+same(double x, double y) {
+    return x == y || std::isnan(x) && std::isnan(y);
+}
+
 
 //
 // The tests
@@ -37,3 +50,107 @@ BOOST_AUTO_TEST_CASE(color_rgb) {
     CHECK_EQ(rgb[0], srgb[0].rgb());
     CHECK_EQ(rgb[1], srgb[1].rgb());
 }
+
+BOOST_AUTO_TEST_CASE(color_batch) {
+    std::vector<sRGB> srgb;
+    for (double r: { 0., .001, .04, .3, .7, 1. })
+        for (double g: { 0., .02, .5, 1. })
+            for (double b: { 0., .0031, .04045, .6, 1., 1.5 })
+                srgb.push_back({ r, g, b });
+    size_t n = srgb.size();
+
+    std::vector<RGB> rgb(n), rgb_fast(n);
+    to_rgb(srgb, rgb, Precision::exact);
+    to_rgb(srgb, rgb_fast);
+    std::vector<sRGB> back(n), back_fast(n);
+    to_srgb(rgb, back, Precision::exact);
+    to_srgb(rgb, back_fast);
+    for (size_t i = 0; i < n; i++) {
+        BOOST_CHECK(rgb[i].r == srgb[i].rgb().r &&
+                    rgb[i].g == srgb[i].rgb().g &&
+                    rgb[i].b == srgb[i].rgb().b);
+        BOOST_CHECK(back[i].r == rgb[i].srgb().r &&
+                    back[i].g == rgb[i].srgb().g &&
+                    back[i].b == rgb[i].srgb().b);
+        auto rel = [](double x, double y) {
+            return std::fabs(x - y) / std::max(1e-300, std::fabs(y));
+        };
+        for (double e: { rel(rgb_fast[i].r, rgb[i].r),
+                         rel(rgb_fast[i].g, rgb[i].g),
+                         rel(rgb_fast[i].b, rgb[i].b),
+                         rel(back_fast[i].r, back[i].r),
+                         rel(back_fast[i].g, back[i].g),
+                         rel(back_fast[i].b, back[i].b) })
+            BOOST_CHECK_SMALL(e, 1e-10);
+    }
+
+    std::vector<HSL> hsl(n);
+    std::vector<YCH> ych(n);
+    to_hsl(srgb, hsl);
+    to_ych(srgb, ych);
+    std::vector<sRGB> from_hsl(n), from_ych(n);
+    to_srgb(hsl, from_hsl);
+    to_srgb(ych, from_ych);
+    for (size_t i = 0; i < n; i++) {
+        HSL h = srgb[i].hsl();
+        BOOST_CHECK(same(hsl[i].h, h.h) && same(hsl[i].s, h.s) &&
+                    same(hsl[i].l, h.l));
+        sRGB s = hsl[i].srgb();
+        BOOST_CHECK(same(from_hsl[i].r, s.r) && same(from_hsl[i].g, s.g) &&
+                    same(from_hsl[i].b, s.b));
+        BOOST_CHECK(eq(ych[i], srgb[i].ych()));
+        CHECK_EQ(from_ych[i], ych[i].srgb());
+    }
+
+    BOOST_CHECK_THROW(to_hsl(srgb, span<HSL>(hsl.data(), n-1)),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(color_batch_image) {
+    Image<sRGB> image({ 5, 3 }, [](ivec2 i) {
+        return sRGB{ i.x * .25, i.y * .5, .3 };
+    });
+    auto rgb = to_rgb(image, Precision::exact);
+    auto ych = to_ych(image);
+    BOOST_CHECK(rgb.size() == image.size());
+    for (int y = 0; y < 3; y++)
+        for (int x = 0; x < 5; x++) {
+            CHECK_EQ(rgb[ivec2(x, y)], image[ivec2(x, y)].rgb());
+            BOOST_CHECK(eq(ych[ivec2(x, y)], image[ivec2(x, y)].ych()));
+        }
+    CHECK_EQ(to_srgb(rgb, Precision::exact)[ivec2(4, 2)], image[ivec2(4, 2)]);
+    auto fast = to_srgb(rgb);
+    for (int y = 0; y < 3; y++)
+        for (int x = 0; x < 5; x++) {
+            sRGB a = fast[ivec2(x, y)], b = image[ivec2(x, y)];
+            for (double e: { a.r - b.r, a.g - b.g, a.b - b.b })
+                BOOST_CHECK_SMALL(e, 1e-10);
+        }
+}
+
+BOOST_AUTO_TEST_CASE(color_float) {
+    static_assert(sizeof(RGBf) == 3 * sizeof(float), "RGBf padded");
+    sRGB srgb{ .7, .85, .02 };
+    sRGBf srgbf = sRGBf(srgb);
+    RGB rgb = RGB(srgbf.rgb());
+    BOOST_CHECK_CLOSE(rgb.r, srgb.rgb().r, 1e-4);
+    BOOST_CHECK_CLOSE(rgb.g, srgb.rgb().g, 1e-4);
+    BOOST_CHECK_CLOSE(rgb.b, srgb.rgb().b, 1e-4);
+
+    YCHf ych = srgbf.ych();
+    sRGB back = sRGB(ych.srgb());
+    BOOST_CHECK_CLOSE(back.r, srgb.r, 1e-4);
+    BOOST_CHECK_CLOSE(back.g, srgb.g, 1e-4);
+    BOOST_CHECK_CLOSE(back.b, srgb.b, 1e-4);
+
+    Gradient<RGBf> gradient;
+    gradient[0] = RGBf{ 0, 0, 1 };
+    gradient[1] = RGBf{ 1, 0, 0 };
+    RGBf mid = gradient(.25);
+    BOOST_CHECK_CLOSE(mid.r, .25f, 1e-4);
+    BOOST_CHECK_CLOSE(mid.b, .75f, 1e-4);
+
+    Image<RGB> image({ 2, 2 }, [](ivec2 i) { return RGB::gray(i.x * .5); });
+    Image<RGBf> imagef(image);
+    BOOST_CHECK_EQUAL(imagef[ivec2(1, 0)].g, .5f);
+}
@@ -0,0 +1,134 @@
+#define BOOST_TEST_MODULE convolve
+#include <boost/test/included/unit_test.hpp>
+
+#include "image.h"
+
+#include "color.h"
+
+#include <pgamecc/convolve.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using std::invalid_argument;
+using std::vector;
+
+using namespace pgamecc;
+using namespace pgamecc::color;
+
+
+// reference convolution reading clamped pixels one at a time
+template<typename Color>
+static Image<Color>
+naive_convolve(const Image<Color>& image, const Image<double>& kernel)
+{
+    ivec2 size = image.size(), r = kernel.size() / 2;
+    return { size, [&](ivec2 i) {
+        Color sum = Color();
+        for (int ky = 0; ky < kernel.size().y; ky++)
+            for (int kx = 0; kx < kernel.size().x; kx++) {
+                ivec2 j = glm::clamp(i + ivec2(kx, ky) - r,
+                                     ivec2(0), size - 1);
+                sum = sum + kernel[ivec2(kx, ky)] * image[j];
+            }
+        return sum;
+    } };
+}
+
+static Image<double>
+outer(const vector<double>& x, const vector<double>& y)
+{
+    return { ivec2(x.size(), y.size()),
+             [&](ivec2 i) { return x[i.x] * y[i.y]; } };
+}
+
+static Image<double>
+noise_image(ivec2 size)
+{
+    return { size, [](ivec2 i) {
+        return std::fmod(std::sin(i.x * 12.9898 + i.y * 78.233) * 43758.5,
+                         1.);
+    } };
+}
+
+
+//
+// The tests
+//
+
+BOOST_AUTO_TEST_CASE(convolve_constant) {
+    Image<RGB> image({9, 7}, [](ivec2) { return RGB{ .2, .4, .8 }; });
+    auto g = gaussian_blur(image, 2.5), b = box_blur(image, 5);
+    for (auto& c: g.pixels())
+        CHECK_EQ(c, (RGB{ .2, .4, .8 }));
+    for (auto& c: b.pixels())
+        CHECK_EQ(c, (RGB{ .2, .4, .8 }));
+}
+
+BOOST_AUTO_TEST_CASE(convolve_reference) {
+    auto image = noise_image({23, 17});
+    vector<double> kx = { .1, .2, .4, .2, .1 }, ky = { -1, 3, -1 };
+
+    auto a = convolve(image, kx, ky);
+    auto b = naive_convolve(image, outer(kx, ky));
+    auto c = convolve(image, outer(kx, ky));
+    auto d = convolve(image, outer(kx, ky), Parallel(3));
+    for (int y = 0; y < 17; y++)
+        for (int x = 0; x < 23; x++) {
+            ivec2 i(x, y);
+            BOOST_CHECK_SMALL(a[i] - b[i], 1e-12);
+            BOOST_CHECK_SMALL(c[i] - b[i], 1e-12);
+            BOOST_CHECK_EQUAL(d[i], c[i]);
+        }
+
+    vector<double> even = { .5, .5 };
+    BOOST_CHECK_THROW(convolve(image, even, ky), invalid_argument);
+    BOOST_CHECK_THROW(box_blur(image, -1), invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(convolve_blur) {
+    auto image = noise_image({40, 31});
+
+    for (int r: { 0, 1, 3, 20 }) {
+        vector<double> k(2*r + 1, 1. / (2*r + 1));
+        auto expected = naive_convolve(image, outer(k, k));
+        auto a = box_blur(image, r);
+        auto b = box_blur(image, r, Parallel(4));
+        for (int y = 0; y < 31; y++)
+            for (int x = 0; x < 40; x++) {
+                ivec2 i(x, y);
+                BOOST_CHECK_SMALL(a[i] - expected[i], 1e-12);
+                BOOST_CHECK_SMALL(b[i] - expected[i], 1e-12);
+            }
+    }
+
+    auto g = gaussian_blur(image, 1.5);
+    auto gp = gaussian_blur(image, 1.5, Parallel(4));
+    BOOST_TEST(g.pixels() == gp.pixels(), boost::test_tools::per_element());
+    // blurring reduces variance
+    auto variance = [](const Image<double>& image) {
+        double sum = 0, sum2 = 0;
+        for (double v: image.pixels()) {
+            sum += v;
+            sum2 += v*v;
+        }
+        double n = image.pixels().size();
+        return sum2/n - sum*sum/n/n;
+    };
+    BOOST_CHECK_LT(variance(g), variance(image) / 4);
+    BOOST_TEST(gaussian_blur(image, 0).pixels() == image.pixels(),
+               boost::test_tools::per_element());
+
+    // colors blur per channel
+    Image<RGB> rgb({40, 31}, [&](ivec2 i) {
+        return RGB{ image[i], 1 - image[i], 0 };
+    });
+    auto grgb = gaussian_blur(rgb, 1.5);
+    for (int y = 0; y < 31; y++)
+        for (int x = 0; x < 40; x++) {
+            ivec2 i(x, y);
+            BOOST_CHECK_SMALL(grgb[i].r - g[i], 1e-12);
+            BOOST_CHECK_SMALL(grgb[i].g - (1 - g[i]), 1e-12);
+        }
+}
@@ -0,0 +1,122 @@
+#define BOOST_TEST_MODULE dirty
+#include <boost/test/included/unit_test.hpp>
+
+#include "image.h"
+
+#include <pgamecc/dirty.h>
+
+#include <algorithm>
+#include <vector>
+
+using std::invalid_argument;
+using std::out_of_range;
+using std::vector;
+
+using namespace pgamecc;
+using pgamecc::operator<<;
+
+
+static long long
+area(const vector<irect>& rects)
+{
+    long long a = 0;
+    for (auto r: rects)
+        a += (long long)r.size().x * r.size().y;
+    return a;
+}
+
+
+//
+// The tests
+//
+
+BOOST_AUTO_TEST_CASE(dirty_irect) {
+    irect a{ivec2(0, 0), ivec2(4, 3)}, b{ivec2(2, 1), ivec2(6, 5)};
+    BOOST_CHECK_EQUAL(a & b, (irect{ivec2(2, 1), ivec2(4, 3)}));
+    BOOST_CHECK_EQUAL(a | b, (irect{ivec2(0, 0), ivec2(6, 5)}));
+    BOOST_CHECK_EQUAL(a | irect{}, a);
+    BOOST_CHECK((a & irect{ivec2(5), ivec2(6)}).empty());
+    BOOST_CHECK(a.contains(ivec2(3, 2)));
+    BOOST_CHECK(!a.contains(ivec2(4, 2)));
+    BOOST_CHECK(a.contains(a & b));
+    BOOST_CHECK(!a.contains(b));
+}
+
+BOOST_AUTO_TEST_CASE(dirty_region) {
+    DirtyRegion d(ivec2(100, 70), 16);
+    BOOST_CHECK(d.empty());
+    BOOST_CHECK(d.rects().empty());
+
+    d.mark(irect{ivec2(20, 20), ivec2(21, 40)});
+    BOOST_CHECK(!d.empty());
+    auto r = d.rects();
+    BOOST_REQUIRE_EQUAL(r.size(), 1);
+    BOOST_CHECK_EQUAL(r[0], (irect{ivec2(16, 16), ivec2(32, 48)}));
+    BOOST_CHECK_EQUAL(d.tile_rects().size(), 2);
+
+    // clipped to the image, partial edge tiles
+    d.mark(ivec2(99, 69));
+    d.mark(irect{ivec2(-10, -10), ivec2(1000, -1)});
+    r = d.rects();
+    BOOST_REQUIRE_EQUAL(r.size(), 2);
+    BOOST_CHECK(std::find(r.begin(), r.end(),
+                          irect{ivec2(96, 64), ivec2(100, 70)}) != r.end());
+
+    d.mark_all();
+    r = d.rects();
+    BOOST_REQUIRE_EQUAL(r.size(), 1);
+    BOOST_CHECK_EQUAL(r[0], (irect{ivec2(0), ivec2(100, 70)}));
+    BOOST_CHECK_EQUAL(area(d.tile_rects()), 100 * 70);
+
+    d.clear();
+    BOOST_CHECK(d.empty());
+
+    // L shape doesn't merge different spans
+    d.mark(irect{ivec2(0, 0), ivec2(48, 16)});
+    d.mark(irect{ivec2(0, 16), ivec2(16, 48)});
+    r = d.rects();
+    BOOST_CHECK_EQUAL(r.size(), 2);
+    BOOST_CHECK_EQUAL(area(r), 48*16 + 16*32);
+}
+
+BOOST_AUTO_TEST_CASE(dirty_remake) {
+    ivec2 size(70, 50);
+    double k = 1;
+    auto f = [&](dvec2 p) { return k * p.x + p.y; };
+    auto batch = [&](span<const dvec2> p, span<double> out) {
+        for (size_t i = 0; i < p.size(); i++)
+            out[i] = f(p[i]);
+    };
+
+    Image<double> a = make_image(size, f);
+    Image<double> b = make_image<double>(size, batch);
+    Image<double> c = a;
+
+    k = 2;
+    DirtyRegion d(size, 16);
+    irect edit{ivec2(10, 20), ivec2(40, 25)};
+    d.mark(edit);
+    int calls = 0;
+    remake_image(a, d, [&](dvec2 p) { calls++; return f(p); });
+    remake_image(b, d, batch);
+    remake_image_parallel(c, d, f, 4);
+    BOOST_CHECK_EQUAL(calls, area(d.rects()));
+
+    Image<double> expected = make_image(size, f);
+    for (int y = 0; y < size.y; y++)
+        for (int x = 0; x < size.x; x++) {
+            ivec2 i(x, y);
+            bool redone = d.rects()[0].contains(i);
+            double v = redone ? expected[i] :
+                       (x + .5) / size.x + (y + .5) / size.y;
+            BOOST_CHECK_EQUAL(a[i], v);
+            BOOST_CHECK_EQUAL(b[i], v);
+            BOOST_CHECK_EQUAL(c[i], v);
+        }
+
+    BOOST_CHECK_THROW(remake_image(a, DirtyRegion(ivec2(1)), f),
+                      invalid_argument);
+    BOOST_CHECK_THROW(a.fill(irect{ivec2(0), size + 1}, [](ivec2) {
+                          return 0.; }),
+                      out_of_range);
+}
@@ -3,11 +3,15 @@
 
 #include "entropy.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iterator>
 #include <set>
 #include <stdexcept>
+#include <vector>
 
 using std::set;
+using std::vector;
 using std::inserter;
 using std::generate_n;
 using std::domain_error;
@@ -67,6 +71,199 @@ BOOST_AUTO_TEST_CASE(entropy_coin) {
 }
 
 
+BOOST_AUTO_TEST_CASE(entropy_generator) {
+    Generator a(42), b(42), c(43);
+    vector<uint64_t> va, vb, vc;
+    for (int i = 0; i < 100; i++) {
+        va.push_back(a());
+        vb.push_back(b());
+        vc.push_back(c());
+    }
+    BOOST_CHECK(va == vb);
+    BOOST_CHECK(va != vc);
+
+    // split streams are the parent's sequence before and after the jump
+    Generator parent(7), before(7), after(7);
+    Generator child = parent.split();
+    after.jump();
+    BOOST_CHECK_EQUAL(child(), before());
+    BOOST_CHECK_EQUAL(parent(), after());
+    BOOST_CHECK(parent() != child());
+    BOOST_CHECK(Generator(7, 0)() != Generator(7, 1)());
+    BOOST_CHECK_EQUAL(Generator(7, 1)(), Generator(7, 1)());
+
+    // the thread generator is reproducible once seeded
+    seed(5);
+    double u1 = uniform(), n1 = normal();
+    seed(5);
+    BOOST_CHECK_EQUAL(uniform(), u1);
+    BOOST_CHECK_EQUAL(normal(), n1);
+
+    Generator g(1);
+    BOOST_CHECK_THROW(g.dice(0), domain_error);
+    vector<int> counts(6);
+    double sum = 0, sum2 = 0, usum = 0;
+    const int m = 60000;
+    for (int i = 0; i < m; i++) {
+        int d = g.dice(6);
+        BOOST_REQUIRE(d >= 0 && d < 6);
+        counts[d]++;
+        double u = g.uniform();
+        BOOST_REQUIRE(u >= 0 && u < 1);
+        usum += u;
+        double x = g.normal();
+        sum += x;
+        sum2 += x * x;
+    }
+    for (int count: counts)
+        BOOST_CHECK(std::abs(count - m / 6) < 500);
+    BOOST_CHECK_SMALL(usum / m - .5, .01);
+    BOOST_CHECK_SMALL(sum / m, .02);
+    BOOST_CHECK_SMALL(sum2 / m - 1, .03);
+}
+
+
+template<typename T>
+void mean_var(const vector<T>& v, double& mean, double& var) {
+    double sum = 0, sum2 = 0;
+    for (double x: v) {
+        sum += x;
+        sum2 += x * x;
+    }
+    mean = sum / v.size();
+    var = sum2 / v.size() - mean * mean;
+}
+
+BOOST_AUTO_TEST_CASE(entropy_bulk) {
+    // sizes that aren't a whole number of lanes
+    vector<double> a(1003), b(1003);
+    BulkGenerator(9).normal(a);
+    BulkGenerator(9).normal(b);
+    BOOST_CHECK(a == b);
+    BOOST_CHECK(diverse(set<double>(a.begin(), a.end())));
+    Generator g(9);
+    BulkGenerator g1(g), g2(g);
+    g1.uniform(a);
+    g2.uniform(b);
+    BOOST_CHECK(a != b);
+
+    BulkGenerator bulk(3);
+    const int m = 200001;
+    double mean, var;
+
+    vector<double> x(m);
+    bulk.uniform(x);
+    for (double u: x)
+        BOOST_REQUIRE(u >= 0 && u < 1);
+    mean_var(x, mean, var);
+    BOOST_CHECK_SMALL(mean - .5, .005);
+    BOOST_CHECK_SMALL(var - 1/12., .002);
+
+    bulk.normal(x);
+    mean_var(x, mean, var);
+    BOOST_CHECK_SMALL(mean, .01);
+    BOOST_CHECK_SMALL(var - 1, .02);
+    int tail = 0, within = 0;
+    for (double v: x) {
+        tail += std::abs(v) > 3.5;
+        within += std::abs(v) < 1;
+    }
+    BOOST_CHECK(tail > 0 && tail < 200); // expect 93
+    BOOST_CHECK_SMALL(within / (double)m - .6827, .005);
+
+    bulk.exp(x, 2);
+    mean_var(x, mean, var);
+    BOOST_CHECK(*std::min_element(x.begin(), x.end()) >= 0);
+    BOOST_CHECK_SMALL(mean - .5, .01);
+    BOOST_CHECK_SMALL(var - .25, .01);
+
+    vector<int> k(m);
+    for (double lambda: { .5, 4., 40. }) {
+        bulk.poisson(k, lambda);
+        BOOST_CHECK(*std::min_element(k.begin(), k.end()) >= 0);
+        mean_var(k, mean, var);
+        BOOST_CHECK_SMALL(mean / lambda - 1, .02);
+        BOOST_CHECK_SMALL(var / lambda - 1, .03);
+    }
+    BOOST_CHECK_THROW(bulk.poisson(k, 0), domain_error);
+
+    // both methods of Generator::poisson(), and the switch between them
+    for (double lambda: { .5, 9.9, 10., 40., 1000. }) {
+        int mode = 0;
+        for (auto& v: k) {
+            v = g.poisson(lambda);
+            mode += v == (int)lambda;
+        }
+        BOOST_CHECK(*std::min_element(k.begin(), k.end()) >= 0);
+        mean_var(k, mean, var);
+        BOOST_CHECK_SMALL(mean / lambda - 1, .02);
+        BOOST_CHECK_SMALL(var / lambda - 1, .03);
+        double pmf = std::exp((int)lambda * std::log(lambda) - lambda -
+                              std::lgamma((int)lambda + 1.));
+        BOOST_CHECK_SMALL(mode / (double)m / pmf - 1, .05);
+    }
+    BOOST_CHECK_THROW(g.poisson(0), domain_error);
+
+    for (int max: { 1, 6, 1000000 }) {
+        bulk.dice(k, max);
+        BOOST_CHECK(in_range(set<int>(k.begin(), k.end()), 0, max));
+        mean_var(k, mean, var);
+        BOOST_CHECK_SMALL(mean - (max - 1) / 2., max * .005);
+    }
+    BOOST_CHECK_THROW(bulk.dice(k, 0), domain_error);
+
+    // thread versions, reproducible once seeded
+    seed(11);
+    fill_uniform(a);
+    seed(11);
+    fill_uniform(b);
+    BOOST_CHECK(a == b);
+    BOOST_CHECK(in_range(set<double>(a.begin(), a.end()), 0, 1));
+    mean_var(a, mean, var);
+    BOOST_CHECK_SMALL(mean - .5, .05);
+
+    seed(12);
+    fill_normal(a);
+    seed(12);
+    fill_normal(b);
+    BOOST_CHECK(a == b);
+    BOOST_CHECK(std::all_of(a.begin(), a.end(),
+                            [](double v) { return std::isfinite(v); }));
+    mean_var(a, mean, var);
+    BOOST_CHECK_SMALL(mean, .15);
+    BOOST_CHECK_SMALL(var - 1, .2);
+
+    seed(13);
+    fill_exp(a, 2);
+    seed(13);
+    fill_exp(b, 2);
+    BOOST_CHECK(a == b);
+    BOOST_CHECK(*std::min_element(a.begin(), a.end()) >= 0);
+    mean_var(a, mean, var);
+    BOOST_CHECK_SMALL(mean - .5, .05);
+
+    vector<int> k2(m);
+    seed(14);
+    fill_dice(k, 6);
+    seed(14);
+    fill_dice(k2, 6);
+    BOOST_CHECK(k == k2);
+    BOOST_CHECK(in_range(set<int>(k.begin(), k.end()), 0, 6));
+    mean_var(k, mean, var);
+    BOOST_CHECK_SMALL(mean - 2.5, .02);
+
+    seed(15);
+    fill_poisson(k, 2);
+    seed(15);
+    fill_poisson(k2, 2);
+    BOOST_CHECK(k == k2);
+    BOOST_CHECK(*std::min_element(k.begin(), k.end()) >= 0);
+    mean_var(k, mean, var);
+    BOOST_CHECK_SMALL(mean - 2, .02);
+    BOOST_CHECK_SMALL(var - 2, .06);
+}
+
+
 BOOST_AUTO_TEST_CASE(entropy_noise) {
     PerlinNoise noise;
 
@@ -82,3 +279,429 @@ BOOST_AUTO_TEST_CASE(entropy_noise) {
 
     BOOST_CHECK(diverse(perlin_samples));
 }
+
+BOOST_AUTO_TEST_CASE(entropy_gradient_noise) {
+    typedef GradientNoise::Basis Basis;
+    typedef GradientNoise::Fractal Fractal;
+
+    // sizes that aren't a whole number of lanes
+    Generator g(5);
+    vector<dvec2> p2(1003);
+    vector<dvec3> p3(1003);
+    auto coord = [&] { return 200 * g.uniform() - 100; };
+    for (auto& p: p2)
+        p = dvec2(coord(), coord());
+    for (auto& p: p3)
+        p = dvec3(coord(), coord(), coord());
+
+    PerlinNoise perlin;
+    RidgedNoise ridged;
+    for (Basis basis: { Basis::perlin, Basis::simplex })
+        for (Fractal fractal: { Fractal::sum, Fractal::ridged }) {
+            GradientNoise noise(basis, fractal);
+            noise.reseed(g);
+            vector<double> a(p3.size()), b(p3.size()), old(p3.size());
+
+            // about the spread of the libnoise modules
+            for (size_t i = 0; i < p3.size(); i++)
+                old[i] = fractal == Fractal::sum ? perlin(p3[i])
+                                                 : ridged(p3[i]);
+            noise(p3, a);
+            double mean, var, old_mean, old_var;
+            mean_var(a, mean, var);
+            mean_var(old, old_mean, old_var);
+            BOOST_CHECK_SMALL(std::sqrt(var / old_var) - 1, .2);
+            BOOST_CHECK_SMALL(mean - old_mean, .1);
+            BOOST_CHECK(diverse(set<double>(a.begin(), a.end())));
+
+            // batches match single points, up to contraction of multiply
+            // and add, which compilers may do differently in vector code
+            for (size_t i = 0; i < p3.size(); i++)
+                BOOST_REQUIRE_SMALL(a[i] - noise(p3[i]), 1e-5);
+            noise(p2, span<double>(a.data(), p2.size()));
+            for (size_t i = 0; i < p2.size(); i++)
+                BOOST_REQUIRE_SMALL(a[i] - noise(p2[i]), 1e-5);
+
+            Image<double> image({ 13, 5 });
+            noise.fill(image, { -3, 2 }, { .25, -.5 });
+            for (int y = 0; y < 5; y++)
+                for (int x = 0; x < 13; x++) {
+                    dvec2 p = dvec2(-3, 2) + dvec2(x, y) * dvec2(.25, -.5);
+                    BOOST_REQUIRE_SMALL(image[ivec2(x, y)] - noise(p), 1e-5);
+                }
+
+            // the seed alone determines the noise
+            GradientNoise same(basis, fractal), other(basis, fractal);
+            Generator g1(7), g2(7);
+            same.reseed(g1);
+            noise.reseed(g2);
+            noise(p3, a);
+            same(p3, b);
+            BOOST_CHECK(a == b);
+            other.reseed(g1);
+            other(p3, b);
+            BOOST_CHECK(a != b);
+
+            BOOST_CHECK_THROW(noise(p3, span<double>(a.data(), 10)),
+                              std::invalid_argument);
+        }
+
+    GradientNoise noise;
+    BOOST_CHECK_THROW(noise.set_octaves(0), domain_error);
+    BOOST_CHECK_THROW(noise.set_octaves(31), domain_error);
+}
+
+
+BOOST_AUTO_TEST_CASE(entropy_noise_fill) {
+    typedef GradientNoise::Basis Basis;
+    typedef GradientNoise::Fractal Fractal;
+
+    // a few rows per thread, and a width that isn't a whole number of lanes
+    ivec2 size(21, 17);
+    dvec2 origin(-3.3, 1.9), step(.37, -.21);
+    dvec3 origin3(.4, -2.2, 5.1);
+    // a cube map face and a tilted plane
+    dvec3 face[2] = { { 0, .3, 0 }, { 0, 0, -.2 } },
+          tilted[2] = { { .3, .1, 0 }, { 0, .2, .25 } };
+
+    auto check = [&](const auto& noise, double tolerance) {
+        Image<double> image(size), threaded(size);
+        noise.fill(image, origin, step);
+        noise.fill(threaded, origin, step, Parallel(3));
+        BOOST_CHECK(image.pixels() == threaded.pixels());
+        for (int y = 0; y < size.y; y++)
+            for (int x = 0; x < size.x; x++)
+                BOOST_REQUIRE_SMALL(image[ivec2(x, y)] -
+                    noise(origin + dvec2(x, y) * step), tolerance);
+
+        for (auto& axes: { face, tilted }) {
+            noise.fill(image, origin3, axes[0], axes[1]);
+            noise.fill(threaded, origin3, axes[0], axes[1], Parallel(3));
+            BOOST_CHECK(image.pixels() == threaded.pixels());
+            for (int y = 0; y < size.y; y++)
+                for (int x = 0; x < size.x; x++) {
+                    dvec3 p = origin3 + double(x) * axes[0] +
+                              double(y) * axes[1];
+                    BOOST_REQUIRE_SMALL(image[ivec2(x, y)] - noise(p),
+                                        tolerance);
+                }
+        }
+    };
+
+    check(PerlinNoise(), 0);
+    check(RidgedNoise(), 0);
+    for (Basis basis: { Basis::perlin, Basis::simplex })
+        for (Fractal fractal: { Fractal::sum, Fractal::ridged }) {
+            GradientNoise noise(basis, fractal);
+            noise.reseed();
+            check(noise, 1e-5);
+        }
+
+    // far from the origin the lattice wraps around rather than breaking down
+    GradientNoise noise;
+    for (double x: { 3e9, -7e15, 1e300 }) {
+        double v = noise(dvec3(x, x / 3, .5));
+        BOOST_CHECK(std::isfinite(v) && std::abs(v) < 2);
+    }
+    // from 2^81 on the wrap divides by 2^30 into [2^51, 2^52), where odd
+    // multiples of 2^30 must still wrap as 2^31 does, not as -2^30
+    GradientNoise simplex(Basis::simplex);
+    simplex.set_octaves(1);
+    double odd = std::ldexp(std::ldexp(1, 51) + 1, 30);
+    BOOST_CHECK_EQUAL(simplex(dvec3(odd, .3, .5)),
+                      simplex(dvec3(std::ldexp(1, 31), .3, .5)));
+}
+
+
+BOOST_AUTO_TEST_CASE(entropy_noise_gradient) {
+    typedef GradientNoise::Basis Basis;
+    typedef GradientNoise::Fractal Fractal;
+
+    Generator g(8);
+    auto coord = [&] { return 20 * g.uniform() - 10; };
+    vector<dvec2> p2(203);
+    vector<dvec3> p3(203);
+    for (auto& p: p2)
+        p = dvec2(coord(), coord());
+    for (auto& p: p3)
+        p = dvec3(coord(), coord(), coord());
+
+    // central differences, which are off where ridges crease
+    const double h = 1e-4;
+    auto close = [](double slope, double derivative) {
+        return std::abs(slope - derivative) < .02 * (1 + std::abs(slope));
+    };
+
+    for (Basis basis: { Basis::perlin, Basis::simplex })
+        for (Fractal fractal: { Fractal::sum, Fractal::ridged }) {
+            GradientNoise noise(basis, fractal);
+            noise.reseed(g);
+            noise.set_frequency(.8);
+            int off = 0, n = 0;
+
+            vector<NoiseGradient<dvec2>> out2(p2.size());
+            noise.gradient(p2, out2);
+            for (size_t i = 0; i < p2.size(); i++) {
+                auto r = noise.gradient(p2[i]);
+                BOOST_REQUIRE_SMALL(r.value - noise(p2[i]), 1e-5);
+                BOOST_REQUIRE_SMALL(out2[i].value - r.value, 1e-5);
+                BOOST_REQUIRE_SMALL(glm::length(out2[i].gradient -
+                                                r.gradient), 1e-3);
+                for (int d = 0; d < 2; d++) {
+                    dvec2 e(0);
+                    e[d] = h;
+                    double slope =
+                        (noise(p2[i] + e) - noise(p2[i] - e)) / (2 * h);
+                    off += !close(slope, r.gradient[d]);
+                    n++;
+                }
+            }
+
+            vector<NoiseGradient<dvec3>> out3(p3.size());
+            noise.gradient(p3, out3);
+            for (size_t i = 0; i < p3.size(); i++) {
+                auto r = noise.gradient(p3[i]);
+                BOOST_REQUIRE_SMALL(r.value - noise(p3[i]), 1e-5);
+                BOOST_REQUIRE_SMALL(out3[i].value - r.value, 1e-5);
+                BOOST_REQUIRE_SMALL(glm::length(out3[i].gradient -
+                                                r.gradient), 1e-3);
+                for (int d = 0; d < 3; d++) {
+                    dvec3 e(0);
+                    e[d] = h;
+                    double slope =
+                        (noise(p3[i] + e) - noise(p3[i] - e)) / (2 * h);
+                    off += !close(slope, r.gradient[d]);
+                    n++;
+                }
+            }
+            if (fractal == Fractal::sum)
+                BOOST_CHECK_EQUAL(off, 0);
+            else
+                BOOST_CHECK_LT(off, n / 50);
+
+            // grids give the same values and gradients
+            ivec2 size(21, 17);
+            Image<double> image(size), values(size);
+            Image<dvec2> grad2(size);
+            dvec2 origin(-3.3, 1.9), step(.37, -.21);
+            noise.fill(values, origin, step);
+            noise.fill(image, grad2, origin, step, Parallel(3));
+            BOOST_CHECK(image.pixels() == values.pixels());
+            for (int y = 0; y < size.y; y++)
+                for (int x = 0; x < size.x; x++) {
+                    auto r = noise.gradient(origin + dvec2(x, y) * step);
+                    BOOST_REQUIRE_SMALL(glm::length(grad2[ivec2(x, y)] -
+                                                    r.gradient), 1e-3);
+                }
+
+            Image<dvec3> grad3(size);
+            dvec3 origin3(.4, -2.2, 5.1);
+            dvec3 face[2] = { { 0, .3, 0 }, { 0, 0, -.2 } },
+                  tilted[2] = { { .3, .1, 0 }, { 0, .2, .25 } };
+            for (auto& axes: { face, tilted }) {
+                noise.fill(image, grad3, origin3, axes[0], axes[1]);
+                for (int y = 0; y < size.y; y++)
+                    for (int x = 0; x < size.x; x++) {
+                        dvec3 p = origin3 + double(x) * axes[0] +
+                                  double(y) * axes[1];
+                        auto r = noise.gradient(p);
+                        BOOST_REQUIRE_SMALL(image[ivec2(x, y)] - r.value,
+                                            1e-5);
+                        BOOST_REQUIRE_SMALL(glm::length(grad3[ivec2(x, y)] -
+                                                        r.gradient), 1e-3);
+                    }
+            }
+
+            Image<dvec2> small(ivec2(3, 3));
+            BOOST_CHECK_THROW(noise.fill(image, small, origin, step),
+                              std::invalid_argument);
+        }
+}
+
+BOOST_AUTO_TEST_CASE(entropy_noise_graph) {
+    typedef GradientNoise::Basis Basis;
+    typedef GradientNoise::Fractal Fractal;
+
+    GradientNoise base, ridges(Basis::simplex, Fractal::ridged), warp;
+    base.reseed();
+    ridges.reseed();
+    warp.reseed();
+    warp.set_octaves(3);
+
+    // equal nodes are shared and constants folded
+    NoiseGraph graph;
+    auto n = graph.noise(base);
+    auto shared = graph.noise(GradientNoise(base));
+    BOOST_CHECK_EQUAL(graph.size(), 1);
+    auto chain = graph.compile(((n * 2 + 1) * 3 - 4) * .5);
+    BOOST_CHECK_EQUAL(chain.size(), 2);
+    BOOST_CHECK_CLOSE(chain(dvec2(.3, .4)), base(dvec2(.3, .4)) * 3 - .5,
+                      1e-9);
+    auto folded = graph.constant(2) * graph.constant(3) + 1;
+    BOOST_CHECK_EQUAL(graph.compile(folded)(dvec2(.3, .4)), 7);
+    BOOST_CHECK_EQUAL(graph.compile(n + shared).size(), 2); // n * 2
+
+    // a warped mix of two noises, against the same computed by hand
+    auto w = graph.noise(warp) * .4;
+    auto warped = graph.noise(base, w, w + graph.coordinate(0) * .1);
+    auto t = clamp(graph.noise(ridges) * .5 + .5, 0, 1);
+    auto out = blend(warped, abs(n), t) - min(n, graph.constant(.2)) +
+               max(graph.coordinate(1), graph.coordinate(2));
+    auto kernel = graph.compile(out);
+    auto by_hand = [&](dvec2 p) {
+        double dx = warp(p) * .4, dy = dx + p.x * .1;
+        double a = base(p + dvec2(dx, dy)), b = std::abs(base(p));
+        double s = std::min(std::max(ridges(p) * .5 + .5, 0.), 1.);
+        return a + (b - a) * s - std::min(base(p), .2) + std::max(p.y, 0.);
+    };
+    Generator g(5);
+    vector<dvec2> points(150);
+    for (auto& p: points)
+        p = { g.uniform() * 20 - 10, g.uniform() * 20 - 10 };
+    vector<double> values(points.size());
+    kernel(span<const dvec2>(points), span<double>(values));
+    for (size_t k = 0; k < points.size(); k++) {
+        BOOST_REQUIRE_SMALL(values[k] - by_hand(points[k]), 1e-5);
+        BOOST_REQUIRE_EQUAL(values[k], kernel(points[k]));
+    }
+
+    // image and grid paths agree with points
+    ivec2 image_size(70, 9);
+    auto image = make_image<double>(image_size, kernel);
+    Image<double> filled(image_size), threaded(image_size);
+    dvec2 step = 1. / dvec2(image_size);
+    kernel.fill(filled, .5 * step, step);
+    kernel.fill(threaded, .5 * step, step, Parallel(3));
+    BOOST_CHECK(filled.pixels() == threaded.pixels());
+    for (int y = 0; y < image_size.y; y++)
+        for (int x = 0; x < image_size.x; x++) {
+            dvec2 p = detail::pixel_center(ivec2(x, y), image_size);
+            BOOST_REQUIRE_EQUAL(image[ivec2(x, y)], kernel(p));
+            // fills step from the origin, so their points may differ from
+            // pixel centers in the last bits, and the float lattice offsets
+            // of the noise by a rounding
+            BOOST_REQUIRE_EQUAL(filled[ivec2(x, y)],
+                                kernel(.5 * step + dvec2(x, y) * step));
+        }
+    dvec3 origin(.4, -2.2, 5.1), dx(0, .3, 0), dy(.1, 0, -.2);
+    kernel.fill(filled, origin, dx, dy);
+    BOOST_CHECK_EQUAL(filled[ivec2(3, 2)],
+                      kernel(origin + 3. * dx + 2. * dy));
+
+    // one cost per compiled node, noise the most expensive
+    auto costs = kernel.profile(span<const dvec2>(points));
+    BOOST_REQUIRE_EQUAL(costs.size(), (size_t)kernel.size());
+    for (auto& c: costs)
+        BOOST_CHECK(c.ns_per_point >= 0 && !c.name.empty());
+    BOOST_CHECK(std::any_of(costs.begin(), costs.end(), [](auto& c) {
+        return c.name == "noise perlin sum, 6 octaves, warped";
+    }));
+
+    NoiseGraph other;
+    BOOST_CHECK_THROW(n + other.constant(1), std::invalid_argument);
+    BOOST_CHECK_THROW(other.compile(n), std::invalid_argument);
+    BOOST_CHECK_THROW(kernel(span<const dvec2>(points),
+                             span<double>(values.data(), 3)),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(clamp(n, 1, 0), domain_error);
+}
+
+BOOST_AUTO_TEST_CASE(entropy_cellular_noise) {
+    CellularNoise noise;
+    noise.reseed();
+    Generator g(11);
+    auto coord = [&] { return g.uniform() * 40 - 20; };
+
+    // F1 and F2 are distances to the nearest points of a fixed set, so they
+    // change no faster than the point moves; a search that missed a cell
+    // would jump where the missed feature takes over
+    for (double jitter: { .45, .7, 1. }) {
+        noise.set_jitter(jitter);
+        for (int k = 0; k < 20000; k++) {
+            dvec2 p(coord(), coord()),
+                  q = p + dvec2(g.uniform(), g.uniform()) * .05;
+            auto a = noise(p), b = noise(q);
+            double moved = glm::length(q - p) + 1e-5;
+            BOOST_REQUIRE(a.f1 >= 0 && a.f1 <= a.f2);
+            BOOST_REQUIRE_LE(std::abs(a.f1 - b.f1), moved);
+            BOOST_REQUIRE_LE(std::abs(a.f2 - b.f2), moved);
+            if (a.f2 - a.f1 > 2 * moved)
+                BOOST_REQUIRE_EQUAL(a.cell, b.cell);
+        }
+        for (int k = 0; k < 20000; k++) {
+            dvec3 p(coord(), coord(), coord()),
+                  q = p + dvec3(g.uniform(), g.uniform(), g.uniform()) * .05;
+            auto a = noise(p), b = noise(q);
+            double moved = glm::length(q - p) + 1e-5;
+            BOOST_REQUIRE(a.f1 >= 0 && a.f1 <= a.f2);
+            BOOST_REQUIRE_LE(std::abs(a.f1 - b.f1), moved);
+            BOOST_REQUIRE_LE(std::abs(a.f2 - b.f2), moved);
+        }
+    }
+
+    // missed features show up as jumps where the search moves on to the
+    // next cell, which random pairs rarely straddle
+    noise.set_jitter(1);
+    for (int k = 0; k < 20000; k++) {
+        dvec3 p(std::floor(coord()) + .9995, coord(), coord()),
+              q = p + dvec3(.001, 0, 0);
+        auto a = noise(p), b = noise(q);
+        BOOST_REQUIRE_LE(std::abs(a.f1 - b.f1), .0011);
+        BOOST_REQUIRE_LE(std::abs(a.f2 - b.f2), .0011);
+        a = noise(dvec2(p.x, p.y)), b = noise(dvec2(q.x, q.y));
+        BOOST_REQUIRE_LE(std::abs(a.f1 - b.f1), .0011);
+        BOOST_REQUIRE_LE(std::abs(a.f2 - b.f2), .0011);
+    }
+    noise.set_jitter(.45);
+
+    // without jitter features are at the middles of the cells
+    CellularNoise grid;
+    grid.set_jitter(0);
+    grid.set_frequency(2);
+    for (int k = 0; k < 100; k++) {
+        dvec2 p(coord(), coord());
+        dvec2 middle = (glm::floor(p * 2.) + .5) / 2.;
+        BOOST_REQUIRE_SMALL(grid(p).f1 - glm::length(p - middle), 1e-6);
+    }
+
+    // batches, fills and seeds
+    vector<dvec3> points(29);
+    for (auto& p: points)
+        p = { coord(), coord(), coord() };
+    vector<CellularSample> out(points.size());
+    for (double jitter: { .45, 1. }) {
+        // lanes of a batch may search more cells than single points do
+        noise.set_jitter(jitter);
+        noise(span<const dvec3>(points), span<CellularSample>(out));
+        for (size_t k = 0; k < points.size(); k++) {
+            auto v = noise(points[k]);
+            BOOST_REQUIRE(out[k].f1 == v.f1 && out[k].f2 == v.f2 &&
+                          out[k].cell == v.cell);
+        }
+    }
+    ivec2 size(21, 17);
+    dvec2 origin(-3.3, 1.9), step(.37, -.21);
+    Image<CellularSample> image(size), threaded(size);
+    noise.fill(image, origin, step);
+    noise.fill(threaded, origin, step, Parallel(3));
+    for (int y = 0; y < size.y; y++)
+        for (int x = 0; x < size.x; x++) {
+            auto v = noise(origin + dvec2(x, y) * step);
+            auto a = image[ivec2(x, y)], b = threaded[ivec2(x, y)];
+            BOOST_REQUIRE(a.f1 == v.f1 && a.f2 == v.f2 && a.cell == v.cell);
+            BOOST_REQUIRE(b.f1 == v.f1 && b.cell == v.cell);
+        }
+
+    CellularNoise same, other;
+    Generator g1(3), g2(3);
+    same.reseed(g1);
+    other.reseed(g2);
+    BOOST_CHECK_EQUAL(same(dvec2(1.3, 2.7)).cell, other(dvec2(1.3, 2.7)).cell);
+    other.reseed(g2);
+    BOOST_CHECK(same(dvec2(1.3, 2.7)).cell != other(dvec2(1.3, 2.7)).cell);
+
+    BOOST_CHECK_THROW(noise.set_jitter(1.5), domain_error);
+    BOOST_CHECK_THROW(noise(span<const dvec3>(points),
+                            span<CellularSample>(out.data(), 3)),
+                      std::invalid_argument);
+}
@@ -5,6 +5,10 @@
 
 #include "color.h"
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 using std::logic_error;
 using std::out_of_range;
 
@@ -73,6 +77,48 @@ BOOST_AUTO_TEST_CASE(image_gradient) {
 }
 
 
+BOOST_AUTO_TEST_CASE(image_gradient_bake) {
+    Gradient<RGB> g;
+    CHECK_EQ(g.bake(16)(.3), RGB());
+    g[.2] = RGB{ 1, 0, 0 };
+    CHECK_EQ(g.bake(16)(5), (RGB{ 1, 0, 0 }));
+
+    // stops on sample points are reproduced exactly
+    g[1] = RGB{ 0, 1, .5 };
+    g[.6] = RGB{ 0, 0, 1 };
+    auto b = g.bake(9);
+    BOOST_CHECK_EQUAL(b.resolution(), 9);
+    for (double v: { -1., .1, .2, .25, .4, .55, .6, .9, 1., 2. })
+        CHECK_EQ(b(v), g(v));
+    CHECK_EQ(b(std::nan("")), g(.2));
+
+    // others are close at high resolution
+    g[.33] = RGB{ .5, .5, .5 };
+    b = g.bake(4096);
+    for (double v = 0; v <= 1.2; v += .01) {
+        RGB d = b(v) - g(v);
+        BOOST_CHECK_SMALL(std::max({ std::fabs(d.r), std::fabs(d.g),
+                                     std::fabs(d.b) }), 1e-3);
+    }
+
+    std::vector<double> v = { .1, .3, .5, .7, 1.1 };
+    std::vector<RGB> out(v.size());
+    b.evaluate(v, out);
+    for (size_t i = 0; i < v.size(); i++)
+        CHECK_EQ(out[i], b(v[i]));
+
+    // texture coordinates hit sample centers
+    auto image = b.image();
+    BOOST_CHECK_EQUAL(image.size().x, 4096);
+    dvec2 m = b.texture_mapping();
+    for (int i: { 0, 1000, 4095 }) {
+        double t = .2 + (1 - .2) * i / 4095;
+        BOOST_CHECK_CLOSE((t * m.x + m.y) * 4096, i + .5, 1e-9);
+        CHECK_EQ(image[ivec2(i, 0)], b(t));
+    }
+    BOOST_CHECK_THROW(g.bake(1), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_CASE(image_image) {
     Image<RGB> m(ivec2{3, 2});
 
@@ -120,3 +166,321 @@ BOOST_AUTO_TEST_CASE(image_render) {
 
     CHECK_EQ(n[ivec2(5, 3)], m[ivec2(5, 3)].srgb());
 }
+
+
+BOOST_AUTO_TEST_CASE(image_samplers) {
+    ivec2 size(8, 6);
+    auto m = make_image(size,
+        [](dvec2 p) { return RGB{ p.x + 2*p.y, p.x * p.y, 1 - p.x }; });
+    auto near = m.nearest();
+    auto lin = m.linear();
+    auto cub = m.cubic();
+
+    // all pass through pixel centers
+    for (int y = 0; y < size.y; y++)
+        for (int x = 0; x < size.x; x++) {
+            ivec2 i(x, y);
+            dvec2 p = (dvec2(i) + .5) / dvec2(size);
+            CHECK_EQ(near(p), m[i]);
+            CHECK_EQ(lin(p), m[i]);
+            CHECK_EQ(cub(p), m[i]);
+            CHECK_EQ(near(p + .49 / dvec2(size)), m[i]);
+        }
+
+    // Catmull-Rom reproduces linear ramps away from the edges, and clamps
+    CHECK_EQ(cub(dvec2(.33, .41)).r, .33 + 2*.41);
+    CHECK_EQ(cub(dvec2(.33, .41)).b, 1 - .33);
+    CHECK_EQ(cub(dvec2(-1, 5)), m[ivec2(0, 5)]);
+    CHECK_EQ(near(dvec2(2, -1)), m[ivec2(7, 0)]);
+
+    // batches and grids give the same samples
+    std::vector<dvec2> points;
+    for (int k = 0; k < 50; k++)
+        points.emplace_back(std::fmod(k * .618, 1.2) - .1,
+                            std::fmod(k * .414, 1.1));
+    std::vector<RGB> out(points.size());
+    cub(points, out);
+    for (size_t k = 0; k < points.size(); k++)
+        CHECK_EQ(out[k], cub(points[k]));
+    lin(points, out);
+    for (size_t k = 0; k < points.size(); k++)
+        CHECK_EQ(out[k], lin(points[k]));
+    BOOST_CHECK_THROW(lin(points, span<RGB>(out.data(), 3)),
+                      std::invalid_argument);
+
+    ivec2 count(7, 5);
+    dvec2 origin(-.05, .1), step(.17, .2);
+    std::vector<RGB> grid(count.x * count.y);
+    cub.grid(origin, step, count, grid);
+    for (int y = 0; y < count.y; y++)
+        for (int x = 0; x < count.x; x++)
+            CHECK_EQ(grid[x + y * count.x],
+                     cub(origin + step * dvec2(x, y)));
+
+    // samplers are batch functions for make_image
+    auto a = make_image<RGB>(ivec2(13, 9), cub);
+    auto b = make_image(ivec2(13, 9), [&](dvec2 p) { return cub(p); });
+    for (int y = 0; y < 9; y++)
+        for (int x = 0; x < 13; x++)
+            CHECK_EQ(a[ivec2(x, y)], b[ivec2(x, y)]);
+}
+
+
+BOOST_AUTO_TEST_CASE(image_view) {
+    Image<double> m(ivec2(6, 5), [](ivec2 i) { return i.x + 10.*i.y; });
+    auto v = m.view(irect{ivec2(1, 2), ivec2(5, 4)});
+    BOOST_TEST(v.size().x == 4);
+    BOOST_TEST(v.size().y == 2);
+    BOOST_TEST(v.stride() == 6);
+    BOOST_TEST(v[ivec2(0, 0)] == 21);
+    BOOST_TEST(v.at_unsafe(ivec2(3, 1)) == 34);
+    BOOST_TEST(v.row(1)[2] == 33);
+    BOOST_CHECK_THROW(v[ivec2(4, 0)], std::out_of_range);
+    BOOST_CHECK_THROW(m.view(irect{ivec2(1), ivec2(7, 2)}), std::out_of_range);
+    BOOST_CHECK_THROW(ImageView<double>(nullptr, ivec2(4, 1), 3),
+                      std::invalid_argument);
+
+    // views share pixels, and views of views add offsets
+    v[ivec2(1, 1)] = -1;
+    BOOST_TEST(m[ivec2(2, 3)] == -1);
+    ImageView<const double> c = v.view(irect{ivec2(1), ivec2(3, 2)});
+    BOOST_TEST(c[ivec2(0, 0)] == -1);
+    BOOST_TEST(c[ivec2(1, 0)] == 33);
+
+    Image<double> copy = v.image();
+    BOOST_TEST(copy.size().x == 4);
+    for (int y = 0; y < 2; y++)
+        for (int x = 0; x < 4; x++)
+            BOOST_TEST(copy[ivec2(x, y)] == m[ivec2(x+1, y+2)]);
+
+    // samplers clamp to the view, not the image
+    auto lin = v.linear();
+    BOOST_TEST(lin(dvec2(0, 0)) == 21);
+    BOOST_TEST(lin(dvec2(1, 1)) == 34);
+    BOOST_TEST(lin(dvec2(.375, .25)) == 22);
+    BOOST_TEST(v.nearest()(dvec2(.9, .9)) == 34);
+
+    // expressions
+    Image<double> e = v.apply([](double x) { return 2*x; }) + copy;
+    for (int y = 0; y < 2; y++)
+        for (int x = 0; x < 4; x++)
+            BOOST_TEST(e[ivec2(x, y)] == 3 * copy[ivec2(x, y)]);
+}
+
+
+BOOST_AUTO_TEST_CASE(image_parallel) {
+    auto f = [](dvec2 p) { return RGB{ p.x * p.y, std::sin(p.x), p.y }; };
+    auto m = make_image(ivec2{37, 23}, f);
+
+    for (int threads: { 0, 1, 2, 3, 8, 64 }) {
+        auto n = make_image_parallel(ivec2{37, 23}, f, threads);
+        BOOST_REQUIRE(n.size() == m.size());
+        bool same = true;
+        for (size_t i = 0; i < m.pixels().size(); i++) {
+            auto a = m.pixels()[i], b = n.pixels()[i];
+            same = same && a.r == b.r && a.g == b.g && a.b == b.b;
+        }
+        BOOST_CHECK(same);
+    }
+
+    auto empty = make_image_parallel(ivec2{0, 5}, f, 4);
+    BOOST_CHECK(empty.pixels().empty());
+
+    BOOST_CHECK_THROW(
+        Image<double>(ivec2{4, 100}, [](ivec2 i) -> double {
+            if (i.y == 50)
+                throw logic_error("test");
+            return i.x;
+        }, Parallel{4}),
+        logic_error);
+}
+
+
+BOOST_AUTO_TEST_CASE(image_batch) {
+    auto f = [](dvec2 p) { return p.x * 3 - p.y; };
+    auto m = make_image(ivec2{300, 7}, f);
+
+    int calls = 0;
+    auto batch = [&](span<const dvec2> p, span<double> out) {
+        BOOST_REQUIRE(p.size() == out.size());
+        BOOST_REQUIRE(p.size() <= (size_t)detail::batch_width);
+        for (size_t k = 0; k < p.size(); k++)
+            out[k] = f(p[k]);
+        calls++;
+    };
+
+    auto n = make_image<double>(ivec2{300, 7}, batch);
+    BOOST_CHECK(n.pixels() == m.pixels());
+    BOOST_CHECK_EQUAL(calls, 7 * 2);
+
+    // no counter or checks here, as threads call it concurrently
+    auto n2 = make_image_parallel<double>(ivec2{300, 7},
+        [&](span<const dvec2> p, span<double> out) {
+            for (size_t k = 0; k < p.size(); k++)
+                out[k] = f(p[k]);
+        }, 3);
+    BOOST_CHECK(n2.pixels() == m.pixels());
+
+    // per-pixel function with explicit type converts on write
+    auto n3 = make_image<float>(ivec2{300, 7}, f);
+    BOOST_CHECK_EQUAL(n3[ivec2(5, 3)], (float)m[ivec2(5, 3)]);
+
+    Image<int> rows(ivec2{5, 3}, [](ivec2 start, span<int> row) {
+        for (size_t x = 0; x < row.size(); x++)
+            row[x] = start.y * 10 + start.x + x;
+    });
+    BOOST_CHECK_EQUAL(rows[ivec2(4, 2)], 24);
+    BOOST_CHECK_EQUAL(rows[ivec2(0, 1)], 10);
+}
+
+
+BOOST_AUTO_TEST_CASE(image_unchecked) {
+    Image<int> m(ivec2{4, 3}, [](ivec2 i) { return i.x + i.y * 10; });
+
+    BOOST_CHECK_EQUAL(m.at_unsafe(ivec2(3, 2)), 23);
+    m.at_unsafe(ivec2(1, 1)) = -1;
+    BOOST_CHECK_EQUAL(m[ivec2(1, 1)], -1);
+
+    auto r = m.row(2);
+    BOOST_CHECK_EQUAL(r.size(), 4u);
+    BOOST_CHECK_EQUAL(r[0], 20);
+    BOOST_CHECK_EQUAL(r[3], 23);
+
+    auto c = m.column(3);
+    BOOST_CHECK_EQUAL(c.size(), 3u);
+    BOOST_CHECK_EQUAL(c[2], 23);
+    BOOST_CHECK_EQUAL(*(c.end() - 1), 23);
+    std::vector<int> col(c.begin(), c.end());
+    BOOST_CHECK(col == (std::vector<int>{ 3, 13, 23 }));
+    for (auto& v: m.column(0))
+        v = 7;
+    BOOST_CHECK_EQUAL(m[ivec2(0, 2)], 7);
+    BOOST_CHECK_EQUAL(std::count(m.begin(), m.end(), 7), 3);
+
+    // images without pixels have empty rows and columns, and row functions
+    // aren't called with empty rows
+    int rows = 0;
+    Image<int> thin(ivec2{0, 3}, [&](ivec2, span<int>) { rows++; });
+    BOOST_CHECK_EQUAL(rows, 0);
+    BOOST_CHECK(thin.row(1).empty());
+    Image<int> flat(ivec2{4, 0});
+    BOOST_CHECK(flat.column(2).begin() == flat.column(2).end());
+
+    // interior fast path matches the clamped border path
+    auto g = make_image(ivec2{6, 5},
+        [](dvec2 p) { return RGB{ p.x, p.y, p.x * p.y }; });
+    auto l = g.linear();
+    for (double y = -.1; y < 1.1; y += .037)
+        for (double x = -.1; x < 1.1; x += .041) {
+            dvec2 f = dvec2(x, y) * dvec2(g.size()) - .5;
+            ivec2 i = ivec2(glm::floor(f));
+            f -= i;
+            auto at = [&](ivec2 j) {
+                return g[glm::clamp(j, ivec2(0), g.size()-1)];
+            };
+            RGB expect = (1-f.y) * ((1-f.x) * at(i) + f.x * at(i+ivec2(1, 0)))
+                       + f.y * ((1-f.x) * at(i+ivec2(0, 1)) + f.x * at(i+1));
+            CHECK_EQ(l(dvec2(x, y)), expect);
+        }
+}
+
+
+BOOST_AUTO_TEST_CASE(image_expr) {
+    auto m = make_image(ivec2{4, 3}, [](dvec2 p) { return p.x + p.y; });
+    auto k = make_image(ivec2{4, 3}, [](dvec2 p) { return p.x * p.y; });
+
+    int calls = 0;
+    auto e = m.apply([&](double v) { calls++; return v * 2; })
+              .apply([](double v) { return v + 1; });
+    BOOST_CHECK_EQUAL(calls, 0); // nothing evaluated yet
+    CHECK_EQ(e[ivec2(2, 1)], m[ivec2(2, 1)] * 2 + 1);
+    BOOST_CHECK_THROW(e[ivec2(4, 0)], out_of_range);
+
+    calls = 0;
+    Image<double> n = e;
+    BOOST_CHECK_EQUAL(calls, 12);
+    CHECK_EQ(n[ivec2(3, 2)], m[ivec2(3, 2)] * 2 + 1);
+
+    Image<double> s = (m + k) * 2. - m / k;
+    CHECK_EQ(s[ivec2(1, 2)],
+             (m[ivec2(1, 2)] + k[ivec2(1, 2)]) * 2 - m[ivec2(1, 2)] /
+             k[ivec2(1, 2)]);
+    Image<double> r = 1. - m;
+    CHECK_EQ(r[ivec2(0, 0)], 1 - m[ivec2(0, 0)]);
+
+    // pixel types may differ
+    Gradient<RGB> g;
+    g[0] = RGB{ 0, 0, 0 };
+    g[2] = RGB{ 1, 2, 4 };
+    Image<RGB> c = m.apply(std::cref(g)) * k;
+    CHECK_EQ(c[ivec2(3, 1)], g(m[ivec2(3, 1)]) * k[ivec2(3, 1)]);
+
+    // temporaries are kept alive by the expression
+    auto t = make_image(ivec2{2, 2}, [](dvec2 p) { return p.x; })
+        .apply([](double v) { return -v; });
+    CHECK_EQ(t.eval()[ivec2(1, 0)], -.75);
+
+    // in place
+    double v32 = m[ivec2(3, 2)];
+    m = m.apply([](double v) { return v * v; }) + k;
+    CHECK_EQ(m[ivec2(3, 2)], v32 * v32 + k[ivec2(3, 2)]);
+
+    BOOST_CHECK_THROW(m + Image<double>(ivec2{2, 2}), std::invalid_argument);
+
+    auto p = (k * 3.).eval(Parallel{2});
+    CHECK_EQ(p[ivec2(2, 2)], 3 * k[ivec2(2, 2)]);
+}
+
+
+template<typename Layout>
+static void
+check_layout(ivec2 size) {
+    Layout layout(size);
+    std::vector<bool> used(Layout::storage(size));
+    for (int y = 0; y < size.y; y++)
+        for (int x = 0; x < size.x; x++) {
+            size_t o = layout.offset(ivec2(x, y));
+            BOOST_REQUIRE(o < used.size());
+            BOOST_REQUIRE(!used[o]);
+            used[o] = true;
+        }
+
+    auto f = [](dvec2 p) { return RGB{ p.x, p.y * p.y, p.x - p.y }; };
+    auto m = make_image(size, f);
+    Image<RGB, Layout> n(m);
+    Image<RGB, Layout> b(size, [&](ivec2 start, span<RGB> row) {
+        for (size_t x = 0; x < row.size(); x++)
+            row[x] = m[start + ivec2(x, 0)];
+    }, Parallel{3});
+    for (int y = 0; y < size.y; y++)
+        for (int x = 0; x < size.x; x++) {
+            CHECK_EQ(n[ivec2(x, y)], m[ivec2(x, y)]);
+            CHECK_EQ(b[ivec2(x, y)], m[ivec2(x, y)]);
+        }
+    BOOST_CHECK_THROW(n[size], out_of_range);
+
+    auto lm = m.linear();
+    auto ln = n.linear();
+    for (dvec2 p: { dvec2(.3, .4), dvec2(.9, .1), dvec2(-1, 2) })
+        CHECK_EQ(ln(p), lm(p));
+
+    Image<RGB> back(n);
+    Image<RGB> e = n * 2.;
+    CHECK_EQ(back[size-1], m[size-1]);
+    CHECK_EQ(e[size-1], m[size-1] * 2);
+}
+
+BOOST_AUTO_TEST_CASE(image_layout) {
+    for (ivec2 size: { ivec2(1, 1), ivec2(16, 16), ivec2(13, 7),
+                       ivec2(3, 40), ivec2(70, 2) }) {
+        check_layout<RowMajor>(size);
+        check_layout<Tiled<8>>(size);
+        check_layout<Tiled<16>>(size);
+        check_layout<Morton>(size);
+    }
+    BOOST_CHECK_EQUAL(Morton::storage(ivec2(16, 16)), 256u);
+    BOOST_CHECK_EQUAL(Morton::storage(ivec2(13, 7)), 128u);
+    BOOST_CHECK_EQUAL(Morton(ivec2(4, 4)).offset(ivec2(1, 1)), 3u);
+    BOOST_CHECK_EQUAL(Morton(ivec2(4, 4)).offset(ivec2(2, 0)), 4u);
+    BOOST_CHECK_EQUAL(Tiled<8>(ivec2(20, 20)).offset(ivec2(9, 1)), 73u);
+}
@@ -0,0 +1,153 @@
+#define BOOST_TEST_MODULE pixel
+#include <boost/test/included/unit_test.hpp>
+
+#include "image.h"
+
+#include "color.h"
+
+#include <pgamecc/pixel.h>
+#include <pgamecc/resample.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace pgamecc;
+using namespace pgamecc::color;
+
+
+//
+// The tests
+//
+
+BOOST_AUTO_TEST_CASE(pixel_half) {
+    // exactly representable values
+    float exact[] = { 0, 1, -2, .5, 1024, 65504, 6.103515625e-05f,
+                      5.9604645e-08f, -.333251953125f };
+    for (float v: exact)
+        BOOST_CHECK_EQUAL(float(half(v)), v);
+
+    BOOST_CHECK_EQUAL(half(1).bits, 0x3c00);
+    BOOST_CHECK_EQUAL(half(-0.f).bits, 0x8000);
+    BOOST_CHECK_EQUAL(half(65504).bits, 0x7bff);
+    BOOST_CHECK_EQUAL(half(65520).bits, 0x7c00); // ties to even, overflows
+    BOOST_CHECK_EQUAL(half(1e10f).bits, 0x7c00);
+    BOOST_CHECK_EQUAL(half(-std::numeric_limits<float>::infinity()).bits,
+                      0xfc00);
+    BOOST_CHECK(std::isnan(float(half(std::nanf("")))));
+
+    // round to nearest even
+    BOOST_CHECK_EQUAL(half(1 + 1/2048.f).bits, 0x3c00);
+    BOOST_CHECK_EQUAL(half(1 + 3/2048.f).bits, 0x3c02);
+    BOOST_CHECK_EQUAL(half(1 + 1.1f/2048).bits, 0x3c01);
+    BOOST_CHECK_EQUAL(half(std::ldexp(1.f, -25)).bits, 0);
+    BOOST_CHECK_EQUAL(half(std::ldexp(1.5f, -25)).bits, 1);
+    BOOST_CHECK_EQUAL(half(std::ldexp(1023.5f, -24)).bits, 0x400);
+
+    // every finite half survives a round trip
+    for (uint32_t b = 0; b < 0x10000; b++)
+        if ((b & 0x7c00) != 0x7c00)
+            BOOST_CHECK_EQUAL(half(half::to_float(b)).bits, b);
+}
+
+BOOST_AUTO_TEST_CASE(pixel_unorm) {
+    BOOST_CHECK_EQUAL(unorm8(0).bits, 0);
+    BOOST_CHECK_EQUAL(unorm8(1).bits, 255);
+    BOOST_CHECK_EQUAL(unorm8(.5).bits, 128);
+    BOOST_CHECK_EQUAL(unorm8(-1).bits, 0);
+    BOOST_CHECK_EQUAL(unorm8(2).bits, 255);
+    BOOST_CHECK_EQUAL(unorm8(std::nan("")).bits, 0);
+    BOOST_CHECK_EQUAL(unorm16(1).bits, 65535);
+    for (int i = 0; i < 256; i++)
+        BOOST_CHECK_EQUAL(unorm8(double(unorm8(i / 255.))).bits, i);
+}
+
+BOOST_AUTO_TEST_CASE(pixel_srgb8) {
+    BOOST_CHECK_EQUAL(srgb8(0).bits, 0);
+    BOOST_CHECK_EQUAL(srgb8(1).bits, 255);
+    BOOST_CHECK_EQUAL(srgb8(-1).bits, 0);
+    BOOST_CHECK_EQUAL(srgb8(2).bits, 255);
+    BOOST_CHECK_EQUAL(srgb8(std::nan("")).bits, 0);
+    BOOST_CHECK_EQUAL(srgb8(.5).bits, 188);
+
+    // decoding is exact and encoding inverts it
+    for (int i = 0; i < 256; i++) {
+        BOOST_CHECK_EQUAL(srgb8::decode(i), (sRGB{ i / 255., 0, 0 }).rgb().r);
+        BOOST_CHECK_EQUAL(srgb8(srgb8::decode(i)).bits, i);
+    }
+
+    // the returned code is within .56 of the exact one, and so within 1 of
+    // the correctly rounded code
+    for (int i = 0; i <= 1 << 16; i++) {
+        double v = std::pow(i / 65536., 2.4); // denser near 0
+        double e = RGB::gray(v).srgb().r * 255;
+        BOOST_CHECK_LE(std::abs(srgb8(v).bits - (int)std::lround(e)), 1);
+        BOOST_CHECK_SMALL(srgb8(v).bits - e, .56);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pixel_srgb8_image) {
+    BOOST_CHECK_EQUAL(sizeof(SRGB8_ALPHA8), 4);
+    Image<RGB> image({ 7, 3 }, [](ivec2 i) {
+        return RGB{ i.x / 6., i.y / 2., .2 };
+    });
+    auto encoded = encode_srgb8(image);
+    auto parallel = encode_srgb8(image, Parallel(2));
+    auto decoded = decode_srgb8(encoded);
+    Image<SRGB8> packed(image);
+    for (int y = 0; y < 3; y++)
+        for (int x = 0; x < 7; x++) {
+            ivec2 i(x, y);
+            SRGB8_ALPHA8 c = encoded[i];
+            BOOST_CHECK_EQUAL(c.r.bits, packed[i].r.bits);
+            BOOST_CHECK_EQUAL(c.b.bits, packed[i].b.bits);
+            BOOST_CHECK_EQUAL(c.a.bits, 255);
+            BOOST_CHECK_EQUAL(parallel[i].g.bits, c.g.bits);
+            CHECK_EQ(decoded[i], RGB(c));
+            BOOST_CHECK_SMALL(decoded[i].g - image[i].g, .01);
+        }
+
+    std::vector<SRGB8_ALPHA8> out(2);
+    BOOST_CHECK_THROW(encode_srgb8(image.row(0), out), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(pixel_image) {
+    auto f = [](ivec2 i) { return RGB{ i.x / 4., i.y / 4., .5 }; };
+    Image<RGB8> a({5, 5}, f);
+    Image<RGB16F> b({5, 5}, f);
+    BOOST_CHECK_EQUAL(sizeof(a.pixels()[0]), 3);
+    BOOST_CHECK_EQUAL((uintptr_t)a.pixels().data() % 64, 0);
+    BOOST_CHECK_EQUAL((uintptr_t)b.pixels().data() % 64, 0);
+
+    for (int y = 0; y < 5; y++)
+        for (int x = 0; x < 5; x++) {
+            RGB c = a[ivec2(x, y)], e = f(ivec2(x, y));
+            BOOST_CHECK_SMALL(c.r - e.r, .5/255);
+            BOOST_CHECK_SMALL(c.g - e.g, .5/255);
+            CHECK_EQ(RGB(b[ivec2(x, y)]), e); // exact in half
+        }
+
+    // samplers and expressions compute in color::RGB
+    CHECK_EQ(b.linear()(dvec2(.3, .5)), (RGB{ .25, .5, .5 }));
+    CHECK_EQ(b.linear()(dvec2(0, 0)), (RGB{ 0, 0, .5 }));
+    Image<RGB> c = b * 2.;
+    CHECK_EQ(c[ivec2(4, 4)], (RGB{ 2, 2, 1 }));
+    Image<RGB16F> d = b + b;
+    CHECK_EQ(RGB(d[ivec2(4, 2)]), (RGB{ 2, 1, 1 }));
+
+    // conversions between pixel types
+    Image<RGB> e(b);
+    CHECK_EQ(e[ivec2(1, 3)], (RGB{ .25, .75, .5 }));
+    Image<RGB8> g(e);
+    BOOST_CHECK_EQUAL(g[ivec2(1, 3)].g.bits, 191);
+
+    auto r = resample(b, ivec2(2, 3), Filter::box);
+    for (int y = 0; y < 3; y++)
+        for (int x = 0; x < 2; x++)
+            BOOST_CHECK_CLOSE(RGB(r[ivec2(x, y)]).b, .5, 1e-3);
+    auto levels = mip_pyramid(b);
+    BOOST_CHECK_EQUAL(levels.size(), 3);
+    CHECK_EQ(RGB(levels[2][ivec2(0, 0)]), (RGB{ .375, .375, .5 }));
+}
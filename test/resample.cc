@@ -0,0 +1,96 @@
+#define BOOST_TEST_MODULE resample
+#include <boost/test/included/unit_test.hpp>
+
+#include "image.h"
+
+#include "color.h"
+
+#include <pgamecc/resample.h>
+
+using std::invalid_argument;
+
+using namespace pgamecc;
+using namespace pgamecc::color;
+
+
+//
+// The tests
+//
+
+static const Filter filters[] = {
+    Filter::box, Filter::bilinear, Filter::lanczos
+};
+
+BOOST_AUTO_TEST_CASE(resample_constant) {
+    Image<RGB> m(ivec2{7, 5}, [](ivec2) { return RGB{ .2, .5, .9 }; });
+    for (auto filter: filters)
+        for (ivec2 size: { ivec2(7, 5), ivec2(3, 2), ivec2(16, 9),
+                           ivec2(1, 1), ivec2(20, 1) }) {
+            auto n = resample(m, size, filter);
+            BOOST_REQUIRE(n.size() == size);
+            for (auto c: n)
+                CHECK_EQ(c, (RGB{ .2, .5, .9 }));
+        }
+
+    BOOST_CHECK_THROW(resample(m, ivec2(0, 3)), invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(resample_filters) {
+    auto m = make_image(ivec2{8, 6},
+        [](dvec2 p) { return p.x * 2 + p.y * p.y; });
+
+    // identity at the same size
+    for (auto filter: filters) {
+        auto n = resample(m, m.size(), filter);
+        for (int y = 0; y < m.size().y; y++)
+            for (int x = 0; x < m.size().x; x++)
+                CHECK_EQ(n[ivec2(x, y)], m[ivec2(x, y)]);
+    }
+
+    // box averages blocks exactly
+    auto box = resample(m, ivec2(4, 3), Filter::box);
+    CHECK_EQ(box[ivec2(1, 2)],
+             (m[ivec2(2, 4)] + m[ivec2(3, 4)] +
+              m[ivec2(2, 5)] + m[ivec2(3, 5)]) / 4);
+
+    // bilinear magnification matches LinearSampler
+    auto big = resample(m, ivec2(24, 18), Filter::bilinear);
+    auto l = m.linear();
+    for (int y = 0; y < 18; y++)
+        for (int x = 0; x < 24; x++)
+            CHECK_EQ(big[ivec2(x, y)], l((dvec2(x, y)+.5)/dvec2(24, 18)));
+
+    // lanczos reproduces a linear ramp away from the edges
+    auto ramp = make_image(ivec2{32, 4}, [](dvec2 p) { return p.x; });
+    auto half = resample(ramp, ivec2(16, 4), Filter::lanczos);
+    for (int x = 4; x < 12; x++)
+        BOOST_CHECK_CLOSE(half[ivec2(x, 1)], (x + .5) / 16, 1e-2);
+}
+
+BOOST_AUTO_TEST_CASE(resample_mip_pyramid) {
+    auto m = make_image(ivec2{4, 4},
+        [](dvec2 p) { return RGB{ p.x, p.y, p.x * p.y }; });
+    auto levels = mip_pyramid(m);
+    BOOST_REQUIRE_EQUAL(levels.size(), 3u);
+    BOOST_CHECK(levels[1].size() == ivec2(2, 2));
+    BOOST_CHECK(levels[2].size() == ivec2(1, 1));
+    CHECK_EQ(levels[0][ivec2(3, 1)], m[ivec2(3, 1)]);
+    CHECK_EQ(levels[1][ivec2(1, 0)],
+             resample(m, ivec2(2, 2), Filter::box)[ivec2(1, 0)]);
+    CHECK_EQ(levels[2][ivec2(0, 0)], (RGB{ .5, .5, .25 }));
+
+    // odd and degenerate sizes follow OpenGL level sizes
+    auto odd = mip_pyramid(Image<double>(ivec2{5, 3},
+        [](ivec2 i) { return i.x + i.y * 10.; }));
+    BOOST_REQUIRE_EQUAL(odd.size(), 3u);
+    BOOST_CHECK(odd[1].size() == ivec2(2, 1));
+    BOOST_CHECK(odd[2].size() == ivec2(1, 1));
+    CHECK_EQ(odd[1][ivec2(1, 0)], 7.5);
+    CHECK_EQ(odd[2][ivec2(0, 0)], 6.5);
+
+    auto line = mip_pyramid(Image<double>(ivec2{1, 4},
+        [](ivec2 i) { return i.y; }));
+    BOOST_REQUIRE_EQUAL(line.size(), 3u);
+    CHECK_EQ(line[1][ivec2(0, 1)], 2.5);
+    CHECK_EQ(line[2][ivec2(0, 0)], 1.5);
+}
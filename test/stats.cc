@@ -0,0 +1,106 @@
+#define BOOST_TEST_MODULE stats
+#include <boost/test/included/unit_test.hpp>
+
+#include "image.h"
+
+#include "color.h"
+
+#include <pgamecc/stats.h>
+
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+using std::invalid_argument;
+using std::out_of_range;
+
+using namespace pgamecc;
+using namespace pgamecc::color;
+
+
+static Image<double>
+noise_image(ivec2 size)
+{
+    return { size, [](ivec2 i) {
+        double v = std::sin(i.x * 12.9898 + i.y * 78.233) * 43758.5;
+        return 1e3 + std::fabs(std::fmod(v, 1.));
+    } };
+}
+
+
+//
+// The tests
+//
+
+BOOST_AUTO_TEST_CASE(stats_summed_area) {
+    ivec2 size(37, 23);
+    auto image = noise_image(size);
+    SummedArea<double> s(image);
+    SummedArea<double> sp(image, Parallel(3));
+
+    irect rects[] = { { ivec2(0), size }, { ivec2(3, 4), ivec2(4, 5) },
+                      { ivec2(10, 2), ivec2(30, 20) },
+                      { ivec2(0, 22), ivec2(37, 23) } };
+    for (auto r: rects) {
+        double sum = 0, sum2 = 0;
+        for (int y = r.min.y; y < r.max.y; y++)
+            for (int x = r.min.x; x < r.max.x; x++) {
+                sum += image[ivec2(x, y)];
+                sum2 += image[ivec2(x, y)] * image[ivec2(x, y)];
+            }
+        double n = r.size().x * r.size().y;
+        double mean = sum / n;
+        double variance = 0;
+        for (int y = r.min.y; y < r.max.y; y++)
+            for (int x = r.min.x; x < r.max.x; x++)
+                variance += std::pow(image[ivec2(x, y)] - mean, 2) / n;
+
+        BOOST_CHECK_CLOSE(s.sum(r), sum, 1e-10);
+        BOOST_CHECK_CLOSE(s.mean(r), mean, 1e-10);
+        BOOST_CHECK_SMALL(s.variance(r) - variance, 1e-9);
+        BOOST_CHECK_EQUAL(sp.sum(r), s.sum(r));
+    }
+
+    BOOST_CHECK_EQUAL(s.sum(irect{ivec2(5), ivec2(5)}), 0);
+    BOOST_CHECK_THROW(s.mean(irect{ivec2(5), ivec2(5)}), invalid_argument);
+    BOOST_CHECK_THROW(s.sum(irect{ivec2(-1), ivec2(5)}), out_of_range);
+    BOOST_CHECK_THROW(s.sum(irect{ivec2(0), size + 1}), out_of_range);
+
+    Image<RGB> rgb(size, [&](ivec2 i) {
+        return RGB{ image[i], 2 * image[i], 0 };
+    });
+    SummedArea<RGB> srgb(rgb);
+    irect r{ivec2(2, 3), ivec2(20, 9)};
+    CHECK_EQ(srgb.mean(r), (RGB{ s.mean(r), 2 * s.mean(r), 0 }));
+    BOOST_CHECK_CLOSE(srgb.variance(r).g, 4 * s.variance(r), 1e-6);
+    BOOST_CHECK_EQUAL(srgb.variance(r).b, 0);
+}
+
+BOOST_AUTO_TEST_CASE(stats_reductions) {
+    auto image = noise_image({50, 40});
+    image[ivec2(3, 7)] = std::nan("");
+    image[ivec2(4, 9)] = -5;
+    image[ivec2(49, 39)] = 2000;
+
+    auto m = minmax(image);
+    BOOST_CHECK_EQUAL(m.first, -5);
+    BOOST_CHECK_EQUAL(m.second, 2000);
+    auto mp = minmax(image, Parallel(4));
+    BOOST_CHECK_EQUAL(mp.first, -5);
+    BOOST_CHECK_EQUAL(mp.second, 2000);
+
+    auto h = histogram(image, 10, 1000, 1001);
+    BOOST_CHECK_EQUAL(std::accumulate(h.begin(), h.end(), size_t(0)),
+                      50 * 40 - 1);
+    BOOST_CHECK_GE(h[0], 1);
+    BOOST_CHECK_GE(h[9], 1);
+    auto hp = histogram(image, 10, 1000, 1001, Parallel(4));
+    BOOST_TEST(h == hp, boost::test_tools::per_element());
+    for (auto c: h)
+        BOOST_CHECK_GT(c, 100);
+    BOOST_CHECK_THROW(histogram(image, 0, 0, 1), invalid_argument);
+    BOOST_CHECK_THROW(histogram(image, 4, 1, 1), invalid_argument);
+
+    auto empty = minmax(Image<double>(ivec2(0)));
+    BOOST_CHECK_GT(empty.first, empty.second);
+}